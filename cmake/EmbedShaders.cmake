@@ -0,0 +1,35 @@
+# Embeds GLSL files into a generated header as constexpr shader::embedded_source values, so
+# programs can be built without reading any file at runtime.
+#
+#   meowfu_embed_shaders(<target> <header name> <files...>)
+#
+# The header is generated into the build tree as "<header name>.hpp" and added to the target's
+# include directories. Every file becomes shader::embedded::<file name as identifier>, e.g.
+# "shaders/basic.vert" becomes shader::embedded::basic_vert. The header is regenerated whenever
+# one of the files changes.
+set(MEOWFU_EMBED_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/embed_shaders.cmake)
+
+function(meowfu_embed_shaders target name)
+    set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/generated)
+    set(output ${output_dir}/${name}.hpp)
+
+    set(files)
+    foreach(file ${ARGN})
+        get_filename_component(file ${file} ABSOLUTE)
+        list(APPEND files ${file})
+    endforeach()
+
+    # lists can't be passed through the command line as is, so they are joined with '|'
+    string(REPLACE ";" "|" joined "${files}")
+
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${CMAKE_COMMAND} -DOUTPUT=${output} -DFILES=${joined} -P ${MEOWFU_EMBED_SCRIPT}
+        DEPENDS ${files} ${MEOWFU_EMBED_SCRIPT}
+        COMMENT "Embedding shaders into ${name}.hpp"
+        VERBATIM
+    )
+
+    target_sources(${target} PRIVATE ${output})
+    target_include_directories(${target} PUBLIC ${output_dir})
+endfunction()
@@ -0,0 +1,49 @@
+# Script mode half of meowfu_embed_shaders, see EmbedShaders.cmake.
+#
+#   cmake -DOUTPUT=<header> -DFILES=<file|file|...> -P embed_shaders.cmake
+string(REPLACE "|" ";" FILES "${FILES}")
+
+set(content "#pragma once\n// generated by meowfu_embed_shaders, do not edit\n#include <embedded_source.hpp>\n\nnamespace shader::embedded\n{\n")
+
+foreach(file ${FILES})
+    get_filename_component(file_name ${file} NAME)
+    string(MAKE_C_IDENTIFIER ${file_name} identifier)
+
+    file(READ ${file} hex HEX)
+    string(LENGTH "${hex}" hex_length)
+    math(EXPR length "${hex_length} / 2")
+
+    # every byte is written as a hex escape, in lines of 32 bytes
+    set(escaped "")
+    foreach(offset RANGE 0 ${hex_length} 64)
+        string(SUBSTRING "${hex}" ${offset} 64 line)
+        string(REGEX REPLACE "([0-9a-f][0-9a-f])" "\\\\x\\1" line "${line}")
+
+        if(NOT line STREQUAL "")
+            string(APPEND escaped "\t\t\"${line}\"\n")
+        endif()
+    endforeach()
+
+    if(escaped STREQUAL "")
+        set(escaped "\t\t\"\"\n")
+    endif()
+
+    string(APPEND content
+        "\tinline constexpr char ${identifier}_code[] =\n${escaped}\t\t;\n\n"
+        "\tinline constexpr embedded_source ${identifier} {\n"
+        "\t\t\"${file_name}\",\n"
+        "\t\tstd::string_view(${identifier}_code, ${length}),\n"
+        "\t\thash::fnv1a(std::string_view(${identifier}_code, ${length})),\n"
+        "\t};\n\n")
+endforeach()
+
+string(REGEX REPLACE "\n\n$" "\n}\n" content "${content}")
+
+# only touch the header if it changed, so unrelated rebuilds don't recompile its includers
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+
+if(NOT "${previous}" STREQUAL "${content}")
+    file(WRITE ${OUTPUT} "${content}")
+endif()
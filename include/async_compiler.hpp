@@ -0,0 +1,298 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <shader.hpp>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <window.hpp>
+
+namespace shader
+{
+	class async_compiler;
+
+	/**
+	 * A program that is being compiled by an async_compiler.
+	 */
+	class pending_shader
+	{
+	public:
+		/**
+		 * Returns whether the program has finished compiling and linking. This never blocks.
+		 */
+		bool ready()
+		{
+			if (state->parallel)
+			{
+				GLint complete = GL_FALSE;
+				glGetProgramiv(state->program, GL_COMPLETION_STATUS_KHR, &complete);
+
+				return complete == GL_TRUE;
+			}
+
+			return state->done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		}
+
+		/**
+		 * Waits for the program to finish and takes ownership of it.
+		 *
+		 * @remarks This throws the same errors as the synchronous shader constructors if a stage failed
+		 *          to compile or the program failed to link. It may only be called once.
+		 */
+		shader get()
+		{
+			if (!state->parallel)
+			{
+				state->done.get();
+				return shader::adopt(state->program);
+			}
+
+			try
+			{
+				for (GLuint stage : state->stages)
+				{
+					shader::check_compile(stage);
+				}
+
+				shader::check_link(state->program);
+			}
+			catch (...)
+			{
+				release_stages(state->program, state->stages);
+				glDeleteProgram(state->program);
+				throw;
+			}
+
+			release_stages(state->program, state->stages);
+			return shader::adopt(state->program);
+		}
+
+	private:
+		friend class async_compiler;
+
+		struct job {
+			std::vector<stage_source> sources;
+			bool parallel;
+
+			GLuint program = 0;
+			std::vector<GLuint> stages;
+
+			std::promise<void> finished;
+			std::shared_future<void> done;
+		};
+
+		std::shared_ptr<job> state;
+
+		pending_shader(std::shared_ptr<job> state)
+			: state { std::move(state) }
+		{
+		}
+
+		static void release_stages(GLuint program, std::vector<GLuint> &stages)
+		{
+			for (GLuint stage : stages)
+			{
+				glDetachShader(program, stage);
+				glDeleteShader(stage);
+			}
+
+			stages.clear();
+		}
+	};
+
+	/**
+	 * Compiles and links programs without blocking the calling thread.
+	 *
+	 * @remarks With GL_KHR_parallel_shader_compile every stage is submitted to the driver right away and
+	 *          the driver compiles them on its own threads, so submitting dozens of programs back to back
+	 *          lets them all compile concurrently. Without it, programs are compiled on a worker thread
+	 *          that owns a hidden context sharing objects with the main one. In both cases the result is
+	 *          picked up through the returned pending_shader.
+	 */
+	class async_compiler
+	{
+	public:
+		async_compiler(gfx::context &context)
+		{
+			parallel = GLEW_KHR_parallel_shader_compile;
+
+			if (parallel)
+			{
+				// let the driver decide how many threads to use
+				glMaxShaderCompilerThreadsKHR(0xffffffff);
+				return;
+			}
+
+			glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+			worker_window = glfwCreateWindow(1, 1, "", nullptr, context.window);
+			glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+			if (worker_window == nullptr)
+			{
+				throw std::runtime_error("unable to create shared context for shader compilation");
+			}
+
+			worker = std::thread([this]() {
+				this->work();
+			});
+		}
+
+		async_compiler(const async_compiler &) = delete;
+		async_compiler &operator=(const async_compiler &) = delete;
+
+		~async_compiler()
+		{
+			if (worker.joinable())
+			{
+				{
+					std::lock_guard lock(mutex);
+					stopping = true;
+				}
+
+				condition.notify_one();
+				worker.join();
+			}
+
+			if (worker_window != nullptr)
+			{
+				glfwDestroyWindow(worker_window);
+			}
+		}
+
+		/**
+		 * Starts compiling and linking a program.
+		 *
+		 * @param stages  The source of every stage of the program.
+		 *
+		 * @return A handle to poll or wait on. Nothing is checked until pending_shader::get is called.
+		 */
+		pending_shader submit(std::vector<stage_source> stages)
+		{
+			auto state = std::make_shared<pending_shader::job>();
+
+			state->sources = std::move(stages);
+			state->parallel = parallel;
+			state->done = state->finished.get_future().share();
+
+			if (parallel)
+			{
+				submit_stages(*state);
+				return pending_shader(state);
+			}
+
+			{
+				std::lock_guard lock(mutex);
+				jobs.push_back(state);
+			}
+
+			condition.notify_one();
+			return pending_shader(state);
+		}
+
+		pending_shader submit(const char *vertex_file_path, const char *fragment_file_path)
+		{
+			return this->submit({
+				stage_source { shader_type::Vertex, shader::read_file(vertex_file_path).value_or("") },
+				stage_source { shader_type::Fragment, shader::read_file(fragment_file_path).value_or("") },
+			});
+		}
+
+		bool is_parallel() const
+		{
+			return parallel;
+		}
+
+	private:
+		bool parallel = false;
+
+		GLFWwindow *worker_window = nullptr;
+		std::thread worker;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::deque<std::shared_ptr<pending_shader::job>> jobs;
+		bool stopping = false;
+
+		static void submit_stages(pending_shader::job &state)
+		{
+			state.program = glCreateProgram();
+
+			for (const stage_source &source : state.sources)
+			{
+				GLuint stage = glCreateShader(static_cast<int>(source.type));
+				const char *code = source.code.c_str();
+
+				glShaderSource(stage, 1, &code, nullptr);
+				glCompileShader(stage);
+				glAttachShader(state.program, stage);
+
+				state.stages.push_back(stage);
+			}
+
+			glLinkProgram(state.program);
+		}
+
+		void work()
+		{
+			glfwMakeContextCurrent(worker_window);
+
+			while (true)
+			{
+				std::shared_ptr<pending_shader::job> state;
+
+				{
+					std::unique_lock lock(mutex);
+					condition.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+					if (stopping)
+					{
+						// fail the jobs that never started, so nobody waits on them forever
+						for (auto &job : jobs)
+						{
+							job->finished.set_exception(std::make_exception_ptr(
+								std::runtime_error("async compiler destroyed before the program was compiled")));
+						}
+
+						jobs.clear();
+						break;
+					}
+
+					state = std::move(jobs.front());
+					jobs.pop_front();
+				}
+
+				submit_stages(*state);
+
+				try
+				{
+					for (GLuint stage : state->stages)
+					{
+						shader::check_compile(stage);
+					}
+
+					shader::check_link(state->program);
+					pending_shader::release_stages(state->program, state->stages);
+
+					// the program is used from the main context, so it has to be complete before handing it over
+					glFinish();
+					state->finished.set_value();
+				}
+				catch (...)
+				{
+					pending_shader::release_stages(state->program, state->stages);
+					glDeleteProgram(state->program);
+
+					state->finished.set_exception(std::current_exception());
+				}
+			}
+
+			glfwMakeContextCurrent(nullptr);
+		}
+	};
+}
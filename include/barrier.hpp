@@ -0,0 +1,233 @@
+#pragma once
+#include <GL/glew.h>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <unordered_map>
+#include <utility>
+
+namespace gfx
+{
+	/**
+	 * How a resource written by a shader is consumed afterwards. Every value is the barrier bit that
+	 * makes shader writes visible to that kind of access.
+	 */
+	enum class access : GLbitfield
+	{
+		storage = GL_SHADER_STORAGE_BARRIER_BIT,
+		uniform = GL_UNIFORM_BARRIER_BIT,
+		vertex = GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT,
+		index = GL_ELEMENT_ARRAY_BARRIER_BIT,
+		indirect = GL_COMMAND_BARRIER_BIT,
+		texture = GL_TEXTURE_FETCH_BARRIER_BIT,
+		image = GL_SHADER_IMAGE_ACCESS_BARRIER_BIT,
+		update = GL_BUFFER_UPDATE_BARRIER_BIT,
+		pixel = GL_PIXEL_BUFFER_BARRIER_BIT,
+		framebuffer = GL_FRAMEBUFFER_BARRIER_BIT,
+		mapped = GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT,
+	};
+
+	/**
+	 * A single resource used by a dispatch or draw, see reads and writes in buffer.hpp and the texture
+	 * helpers below.
+	 */
+	struct resource_use {
+		uint64_t resource;
+		access usage;
+		bool write;
+	};
+
+	inline uint64_t buffer_resource(GLuint id)
+	{
+		return id;
+	}
+
+	inline uint64_t texture_resource(GLuint id)
+	{
+		// buffers and textures have separate names, so they are kept apart in the upper half
+		return (uint64_t(1) << 32) | id;
+	}
+
+	/**
+	 * Declares that a texture is read, e.g. sampled (access::texture) or loaded as an image (access::image).
+	 */
+	inline resource_use reads_texture(GLuint texture, access usage)
+	{
+		return { texture_resource(texture), usage, false };
+	}
+
+	/**
+	 * Declares that a texture is written by a shader, through an image binding.
+	 */
+	inline resource_use writes_texture(GLuint texture)
+	{
+		return { texture_resource(texture), access::image, true };
+	}
+
+	/**
+	 * Issues memory barriers only where a later command depends on an earlier shader write.
+	 *
+	 * @remarks Writes are recorded after a command is issued, and nothing is waited on at that point.
+	 *          Before the next command, its reads are checked against those writes, and a single
+	 *          glMemoryBarrier with just the bits of the dependent reads is issued. Dispatches that do
+	 *          not read each other's results therefore run back to back without any barrier, and a
+	 *          barrier for one kind of access is not repeated for later reads of the same kind.
+	 *
+	 *          Every barrier bit covers all writes issued before it, so the tracker only has to
+	 *          remember when each resource was last written and when each bit was last issued.
+	 */
+	class barrier_tracker
+	{
+	public:
+		static barrier_tracker &get()
+		{
+			static barrier_tracker tracker;
+			return tracker;
+		}
+
+		barrier_tracker(const barrier_tracker &) = delete;
+		barrier_tracker &operator=(const barrier_tracker &) = delete;
+
+		/**
+		 * Issues the barrier needed before a command that uses the given resources, if any.
+		 *
+		 * @param resources  Every resource the command reads or writes.
+		 */
+		void prepare(std::span<const resource_use> resources)
+		{
+			for (const resource_use &use : resources)
+			{
+				this->require(use);
+			}
+
+			this->flush();
+		}
+
+		/**
+		 * Adds a single resource to the barrier of the next command, without issuing it yet.
+		 */
+		void require(const resource_use &use)
+		{
+			auto written = writes_serial.find(use.resource);
+
+			if (written == writes_serial.end())
+			{
+				return;
+			}
+
+			GLbitfield bit = static_cast<GLbitfield>(use.usage);
+
+			if (written->second > barrier_serial[std::countr_zero(bit)])
+			{
+				required |= bit;
+			}
+		}
+
+		/**
+		 * Issues the barrier for every resource added with require since the last flush, if any.
+		 */
+		void flush()
+		{
+			if (required == 0)
+			{
+				current_skipped++;
+				return;
+			}
+
+			glMemoryBarrier(required);
+			current_issued++;
+
+			for (GLbitfield remaining = required; remaining != 0; remaining &= remaining - 1)
+			{
+				barrier_serial[std::countr_zero(remaining)] = serial;
+			}
+
+			required = 0;
+		}
+
+		void prepare(std::initializer_list<resource_use> resources)
+		{
+			this->prepare(std::span<const resource_use>(resources.begin(), resources.size()));
+		}
+
+		/**
+		 * Records the shader writes of a command that has just been issued.
+		 *
+		 * @param resources  Every resource the command reads or writes, reads are ignored.
+		 */
+		void commit(std::span<const resource_use> resources)
+		{
+			serial++;
+
+			for (const resource_use &use : resources)
+			{
+				if (use.write)
+				{
+					writes_serial[use.resource] = serial;
+				}
+			}
+		}
+
+		void commit(std::initializer_list<resource_use> resources)
+		{
+			this->commit(std::span<const resource_use>(resources.begin(), resources.size()));
+		}
+
+		/**
+		 * Moves the pending shader write of a resource to another one, e.g. when a buffer is copied
+		 * into new storage with a new name.
+		 */
+		void replace(uint64_t from, uint64_t to)
+		{
+			auto written = writes_serial.find(from);
+
+			if (written == writes_serial.end())
+			{
+				return;
+			}
+
+			writes_serial[to] = written->second;
+			writes_serial.erase(from);
+		}
+
+		/**
+		 * Publishes this frame's counts and starts counting the next frame. Called by frame::framework.
+		 */
+		void end_frame()
+		{
+			last_issued = std::exchange(current_issued, 0);
+			last_skipped = std::exchange(current_skipped, 0);
+		}
+
+		/**
+		 * Returns the number of commands in the last frame that needed a barrier.
+		 */
+		int get_issued() const
+		{
+			return last_issued;
+		}
+
+		/**
+		 * Returns the number of commands in the last frame that did not need any barrier.
+		 */
+		int get_skipped() const
+		{
+			return last_skipped;
+		}
+
+	private:
+		uint64_t serial = 0;
+		GLbitfield required = 0;
+		std::array<uint64_t, 32> barrier_serial {};
+		std::unordered_map<uint64_t, uint64_t> writes_serial;
+
+		int current_issued = 0;
+		int current_skipped = 0;
+		int last_issued = 0;
+		int last_skipped = 0;
+
+		barrier_tracker() = default;
+	};
+}
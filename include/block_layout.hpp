@@ -0,0 +1,465 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstddef>
+#include <format>
+#include <glm/glm.hpp>
+#include <optional>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <uniform_table.hpp>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * The GLSL type matching a C++ type, or 0 if there is none.
+	 */
+	template<typename T>
+	constexpr GLenum glsl_type = 0;
+
+	template<>
+	constexpr GLenum glsl_type<float> = GL_FLOAT;
+	template<>
+	constexpr GLenum glsl_type<int> = GL_INT;
+	template<>
+	constexpr GLenum glsl_type<unsigned int> = GL_UNSIGNED_INT;
+	template<>
+	constexpr GLenum glsl_type<glm::vec2> = GL_FLOAT_VEC2;
+	template<>
+	constexpr GLenum glsl_type<glm::vec3> = GL_FLOAT_VEC3;
+	template<>
+	constexpr GLenum glsl_type<glm::vec4> = GL_FLOAT_VEC4;
+	template<>
+	constexpr GLenum glsl_type<glm::ivec2> = GL_INT_VEC2;
+	template<>
+	constexpr GLenum glsl_type<glm::ivec3> = GL_INT_VEC3;
+	template<>
+	constexpr GLenum glsl_type<glm::ivec4> = GL_INT_VEC4;
+	template<>
+	constexpr GLenum glsl_type<glm::uvec2> = GL_UNSIGNED_INT_VEC2;
+	template<>
+	constexpr GLenum glsl_type<glm::uvec3> = GL_UNSIGNED_INT_VEC3;
+	template<>
+	constexpr GLenum glsl_type<glm::uvec4> = GL_UNSIGNED_INT_VEC4;
+	template<>
+	constexpr GLenum glsl_type<glm::mat2> = GL_FLOAT_MAT2;
+	template<>
+	constexpr GLenum glsl_type<glm::mat3> = GL_FLOAT_MAT3;
+	template<>
+	constexpr GLenum glsl_type<glm::mat4> = GL_FLOAT_MAT4;
+
+	/**
+	 * The C++ side of a single block member, usually declared with BLOCK_MEMBER.
+	 */
+	struct block_member {
+		std::string_view name;
+		size_t offset;
+		size_t size;
+		GLenum type;
+	};
+
+/**
+ * Describes a member of a struct that mirrors a uniform or shader storage block, e.g.
+ *
+ *     constexpr shader::block_member camera_members[] = {
+ *         BLOCK_MEMBER(camera, view),
+ *         BLOCK_MEMBER(camera, position),
+ *     };
+ */
+#define BLOCK_MEMBER(type, member)                                                    \
+	shader::block_member                                                              \
+	{                                                                                 \
+		#member, offsetof(type, member), sizeof(type::member),                        \
+			shader::glsl_type<std::remove_all_extents_t<decltype(type::member)>>      \
+	}
+
+	/**
+	 * A member of a block as laid out by the driver.
+	 */
+	struct block_variable {
+		std::string name;
+		GLenum type;
+		GLint offset;
+		GLint array_size;
+		GLint array_stride;
+		GLint matrix_stride;
+
+		/**
+		 * Returns the number of columns of a matrix type, or 0 for any other type.
+		 */
+		static int matrix_columns(GLenum type)
+		{
+			switch (type)
+			{
+			case GL_FLOAT_MAT2:
+			case GL_FLOAT_MAT2x3:
+			case GL_FLOAT_MAT2x4:
+				return 2;
+			case GL_FLOAT_MAT3:
+			case GL_FLOAT_MAT3x2:
+			case GL_FLOAT_MAT3x4:
+				return 3;
+			case GL_FLOAT_MAT4:
+			case GL_FLOAT_MAT4x2:
+			case GL_FLOAT_MAT4x3:
+				return 4;
+			}
+
+			return 0;
+		}
+
+		/**
+		 * Returns the size (in bytes) of a single element, including the padding of matrix columns.
+		 */
+		size_t element_size() const
+		{
+			int columns = matrix_columns(type);
+			return columns > 0 ? static_cast<size_t>(columns * matrix_stride) : uniform_type_size(type);
+		}
+
+		/**
+		 * Returns the size (in bytes) the member occupies in the buffer, or 0 for a runtime sized array.
+		 */
+		size_t size() const
+		{
+			if (array_stride > 0)
+			{
+				return static_cast<size_t>(array_size * array_stride);
+			}
+
+			return element_size();
+		}
+	};
+
+	struct block_layout {
+		std::string name;
+		GLenum interface;
+		GLint data_size;
+		std::vector<block_variable> variables;
+	};
+
+	/**
+	 * Queries the layout of a uniform or shader storage block of a linked program.
+	 *
+	 * @param program  The ID of the linked program.
+	 * @param name     The name of the block (not its instance name).
+	 *
+	 * @return The layout, or nothing if the program has no active block with that name.
+	 *
+	 * @remarks Member names are returned without the block prefix and without the "[0]" suffix of arrays,
+	 *          so they match the names of the C++ members. This requires OpenGL 4.3 or
+	 *          ARB_program_interface_query.
+	 */
+	inline std::optional<block_layout> reflect_block(GLuint program, const std::string &name)
+	{
+		if (!GLEW_ARB_program_interface_query)
+		{
+			throw std::runtime_error("block reflection requires ARB_program_interface_query");
+		}
+
+		GLenum interface = GL_UNIFORM_BLOCK;
+		GLenum variable_interface = GL_UNIFORM;
+		GLuint index = glGetProgramResourceIndex(program, interface, name.c_str());
+
+		if (index == GL_INVALID_INDEX)
+		{
+			interface = GL_SHADER_STORAGE_BLOCK;
+			variable_interface = GL_BUFFER_VARIABLE;
+			index = glGetProgramResourceIndex(program, interface, name.c_str());
+		}
+
+		if (index == GL_INVALID_INDEX)
+		{
+			return std::nullopt;
+		}
+
+		block_layout layout { name, interface, 0, {} };
+
+		const GLenum block_properties[] = { GL_BUFFER_DATA_SIZE, GL_NUM_ACTIVE_VARIABLES };
+		GLint block_values[2] = {};
+
+		glGetProgramResourceiv(program, interface, index, 2, block_properties, 2, nullptr, block_values);
+		layout.data_size = block_values[0];
+
+		std::vector<GLint> indices(block_values[1]);
+		const GLenum active_variables = GL_ACTIVE_VARIABLES;
+
+		glGetProgramResourceiv(program, interface, index, 1, &active_variables, static_cast<GLsizei>(indices.size()), nullptr, indices.data());
+
+		for (GLint variable : indices)
+		{
+			const GLenum properties[] = { GL_NAME_LENGTH, GL_TYPE, GL_OFFSET, GL_ARRAY_SIZE, GL_ARRAY_STRIDE, GL_MATRIX_STRIDE };
+			GLint values[6] = {};
+
+			glGetProgramResourceiv(program, variable_interface, variable, 6, properties, 6, nullptr, values);
+
+			std::vector<char> buffer(values[0] + 1);
+			glGetProgramResourceName(program, variable_interface, variable, values[0], nullptr, buffer.data());
+
+			std::string variable_name(buffer.data());
+
+			if (variable_name.starts_with(name + "."))
+			{
+				variable_name.erase(0, name.size() + 1);
+			}
+
+			if (variable_name.ends_with("[0]"))
+			{
+				variable_name.erase(variable_name.size() - 3);
+			}
+
+			layout.variables.push_back({ variable_name, static_cast<GLenum>(values[1]), values[2], values[3], values[4], values[5] });
+		}
+
+		return layout;
+	}
+
+	/**
+	 * Compares the layout of a block with the C++ struct that mirrors it.
+	 *
+	 * @param layout       The layout returned by reflect_block.
+	 * @param members      The members of the C++ struct.
+	 * @param struct_size  The size of the C++ struct.
+	 *
+	 * @return A description of every mismatch, empty if the struct can be copied into the block as is.
+	 */
+	inline std::vector<std::string> compare_block(const block_layout &layout, std::span<const block_member> members, size_t struct_size)
+	{
+		std::vector<std::string> errors;
+		bool runtime_sized = false;
+
+		for (const block_variable &variable : layout.variables)
+		{
+			auto member = std::find_if(members.begin(), members.end(), [&](const block_member &member) {
+				return member.name == variable.name;
+			});
+
+			if (member == members.end())
+			{
+				errors.push_back(std::format("{} is not described by the C++ struct", variable.name));
+				continue;
+			}
+
+			if (member->offset != static_cast<size_t>(variable.offset))
+			{
+				errors.push_back(std::format("{} is at offset {} in C++ but {} in GLSL", variable.name, member->offset, variable.offset));
+			}
+
+			// GLSL booleans are mirrored by ints, as C++ bools are a single byte
+			GLenum variable_type = variable.type == GL_BOOL ? GL_INT : variable.type;
+
+			if (member->type != 0 && member->type != variable_type)
+			{
+				errors.push_back(std::format("{} has type 0x{:x} in C++ but 0x{:x} in GLSL", variable.name, member->type, variable.type));
+			}
+
+			// runtime sized arrays have no size of their own, only their stride has to match
+			if (variable.array_size == 0)
+			{
+				runtime_sized = true;
+
+				if (member->size != static_cast<size_t>(variable.array_stride))
+				{
+					errors.push_back(std::format("{} has an element size of {} in C++ but a stride of {} in GLSL", variable.name, member->size, variable.array_stride));
+				}
+
+				continue;
+			}
+
+			if (member->size != variable.size())
+			{
+				errors.push_back(std::format("{} is {} bytes in C++ but {} bytes in GLSL", variable.name, member->size, variable.size()));
+			}
+		}
+
+		for (const block_member &member : members)
+		{
+			auto variable = std::find_if(layout.variables.begin(), layout.variables.end(), [&](const block_variable &variable) {
+				return variable.name == member.name;
+			});
+
+			if (variable == layout.variables.end())
+			{
+				errors.push_back(std::format("{} is not an active member of {}", member.name, layout.name));
+			}
+		}
+
+		if (!runtime_sized && struct_size < static_cast<size_t>(layout.data_size))
+		{
+			errors.push_back(std::format("{} is {} bytes in C++ but {} bytes in GLSL", layout.name, struct_size, layout.data_size));
+		}
+
+		return errors;
+	}
+
+	/**
+	 * Throws if a block does not match the C++ struct that mirrors it, listing every mismatch.
+	 *
+	 * @param program  The ID of the linked program.
+	 * @param name     The name of the block.
+	 * @param members  The members of the C++ struct, usually declared with BLOCK_MEMBER.
+	 *
+	 * @remarks This is meant to be called once after linking, e.g. at startup. If the driver cannot
+	 *          reflect blocks the check is skipped with a warning.
+	 */
+	template<typename T>
+	void validate_block(GLuint program, const std::string &name, std::span<const block_member> members)
+	{
+		if (!GLEW_ARB_program_interface_query)
+		{
+			spdlog::warn("skipping layout validation of {}, ARB_program_interface_query is not supported", name);
+			return;
+		}
+
+		std::optional<block_layout> layout = reflect_block(program, name);
+
+		if (!layout.has_value())
+		{
+			throw std::runtime_error(std::format("program has no active block named {}", name));
+		}
+
+		std::vector<std::string> errors = compare_block(*layout, members, sizeof(T));
+
+		if (errors.empty())
+		{
+			return;
+		}
+
+		std::string message = std::format("block {} does not match its C++ struct:", name);
+
+		for (const std::string &error : errors)
+		{
+			message += "\n\t" + error;
+		}
+
+		throw std::runtime_error(message);
+	}
+
+	/**
+	 * Returns the C++ spelling of a GLSL type, or nothing if there is no glm equivalent.
+	 */
+	inline std::optional<std::string_view> glsl_type_name(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT:
+			return "float";
+		case GL_INT:
+		case GL_BOOL:
+			return "int";
+		case GL_UNSIGNED_INT:
+			return "unsigned int";
+		case GL_FLOAT_VEC2:
+			return "glm::vec2";
+		case GL_FLOAT_VEC3:
+			return "glm::vec3";
+		case GL_FLOAT_VEC4:
+			return "glm::vec4";
+		case GL_INT_VEC2:
+			return "glm::ivec2";
+		case GL_INT_VEC3:
+			return "glm::ivec3";
+		case GL_INT_VEC4:
+			return "glm::ivec4";
+		case GL_UNSIGNED_INT_VEC2:
+			return "glm::uvec2";
+		case GL_UNSIGNED_INT_VEC3:
+			return "glm::uvec3";
+		case GL_UNSIGNED_INT_VEC4:
+			return "glm::uvec4";
+		}
+
+		return std::nullopt;
+	}
+
+	/**
+	 * Generates a C++ struct matching a block, together with its BLOCK_MEMBER description.
+	 *
+	 * @param layout       The layout returned by reflect_block.
+	 * @param struct_name  The name of the generated struct.
+	 *
+	 * @return The source of a header that can be written to disk and included.
+	 *
+	 * @remarks Members are emitted in offset order, with explicit padding only where the GLSL layout
+	 *          requires it. Matrices whose columns are padded (e.g. a std140 mat3) are emitted as glm
+	 *          matrices with 4 rows, and arrays whose stride is larger than their element are emitted
+	 *          as arrays of padded elements, so the struct can always be copied into the block as is.
+	 */
+	inline std::string generate_block_struct(const block_layout &layout, std::string_view struct_name)
+	{
+		std::vector<block_variable> variables = layout.variables;
+
+		std::sort(variables.begin(), variables.end(), [](const block_variable &a, const block_variable &b) {
+			return a.offset < b.offset;
+		});
+
+		std::string members;
+		std::string description;
+		size_t cursor = 0;
+		int padding = 0;
+
+		for (const block_variable &variable : variables)
+		{
+			if (static_cast<size_t>(variable.offset) > cursor)
+			{
+				members += std::format("\tchar _padding{}[{}];\n", padding++, variable.offset - cursor);
+			}
+
+			std::string type;
+			int columns = block_variable::matrix_columns(variable.type);
+
+			if (columns > 0)
+			{
+				type = std::format("glm::mat{}x{}", columns, variable.matrix_stride / 4);
+			}
+			else if (auto name = glsl_type_name(variable.type))
+			{
+				type = *name;
+			}
+			else
+			{
+				throw std::runtime_error(std::format("{} has a type without a C++ equivalent", variable.name));
+			}
+
+			size_t element_size = variable.element_size();
+			bool array = variable.array_stride > 0;
+
+			if (array && static_cast<size_t>(variable.array_stride) > element_size)
+			{
+				type = std::format("struct {{ {} value; char _padding[{}]; }}", type, variable.array_stride - element_size);
+			}
+
+			if (array)
+			{
+				// a runtime sized array is emitted with a single element, to be indexed past its end
+				members += std::format("\t{} {}[{}];\n", type, variable.name, std::max(variable.array_size, 1));
+			}
+			else
+			{
+				members += std::format("\t{} {};\n", type, variable.name);
+			}
+
+			description += std::format("\tBLOCK_MEMBER({}, {}),\n", struct_name, variable.name);
+			cursor = variable.offset + (array ? std::max(variable.array_size, 1) * variable.array_stride : static_cast<int>(element_size));
+		}
+
+		if (static_cast<size_t>(layout.data_size) > cursor)
+		{
+			members += std::format("\tchar _padding{}[{}];\n", padding, layout.data_size - cursor);
+		}
+
+		return std::format("#pragma once\n"
+						   "#include <block_layout.hpp>\n"
+						   "#include <glm/glm.hpp>\n\n"
+						   "// generated from block {}, do not edit\n"
+						   "struct {} {{\n{}}};\n\n"
+						   "static_assert(sizeof({}) == {});\n\n"
+						   "constexpr shader::block_member {}_members[] = {{\n{}}};\n",
+			layout.name, struct_name, members, struct_name, std::max<size_t>(cursor, layout.data_size), struct_name, description);
+	}
+}
@@ -1,8 +1,11 @@
 #pragma once
 #include <GL/glew.h>
-#include <functional>
+#include <algorithm>
+#include <barrier.hpp>
+#include <deletion_queue.hpp>
 #include <memory>
 #include <render.hpp>
+#include <utility>
 
 enum class draw_type : int
 {
@@ -14,12 +17,28 @@ enum class draw_type : int
 enum class buffer_type : int
 {
 	array = GL_ARRAY_BUFFER,
+	element_array = GL_ELEMENT_ARRAY_BUFFER,
+	draw_indirect = GL_DRAW_INDIRECT_BUFFER,
+	dispatch_indirect = GL_DISPATCH_INDIRECT_BUFFER,
 	shader_storage = GL_SHADER_STORAGE_BUFFER,
 	uniform_buffer = GL_UNIFORM_BUFFER,
 };
 
 namespace buffer
 {
+	/**
+	 * Returns whether direct state access (OpenGL 4.5 or ARB_direct_state_access) is available.
+	 *
+	 * @remarks With direct state access, buffers can be created and written to by name, without
+	 *          binding them first. The result is queried once, so this must not be called before
+	 *          the context (and GLEW) has been initialized.
+	 */
+	inline bool direct_state_access()
+	{
+		static const bool supported = GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+		return supported;
+	}
+
 	class buffer
 	{
 	public:
@@ -32,14 +51,25 @@ namespace buffer
 		 * @param buffer_type   The type of buffer being created.
 		 *
 		 * @remarks This constructor generates a buffer ID using glGenBuffers and initializes the buffer
-		 *          with the specified data using glBufferData. It is recommended to preallocate memory
-		 *          using the "size" parameter, as resizing later on is not recommended unless needed.
+		 *          with the specified data using glBufferData, or using glCreateBuffers and
+		 *          glNamedBufferData when direct state access is available. It is recommended to
+		 *          preallocate memory using the "size" parameter, as resizing later on is not recommended
+		 *          unless needed.
 		 */
 		buffer(void *data, int size, draw_type type, buffer_type buffer_type)
 			: _draw_type { type }
 			, _buffer_type(buffer_type)
 			, size { size }
 		{
+			deletion_queue::get().created();
+
+			if (direct_state_access())
+			{
+				glCreateBuffers(1, &buffer_id);
+				glNamedBufferData(buffer_id, size, data, static_cast<int>(type));
+				return;
+			}
+
 			glGenBuffers(1, &buffer_id);
 
 			this->bind([&]() {
@@ -47,6 +77,47 @@ namespace buffer
 			});
 		}
 
+		buffer(const buffer &) = delete;
+		buffer &operator=(const buffer &) = delete;
+
+		buffer(buffer &&other) noexcept
+			: buffer_id { std::exchange(other.buffer_id, 0) }
+			, _draw_type { other._draw_type }
+			, _buffer_type { other._buffer_type }
+			, size { other.size }
+			, used { other.used }
+			, growth_factor { other.growth_factor }
+		{
+		}
+
+		buffer &operator=(buffer &&other) noexcept
+		{
+			if (this != &other)
+			{
+				this->release();
+
+				buffer_id = std::exchange(other.buffer_id, 0);
+				_draw_type = other._draw_type;
+				_buffer_type = other._buffer_type;
+				size = other.size;
+				used = other.used;
+				growth_factor = other.growth_factor;
+			}
+
+			return *this;
+		}
+
+		/**
+		 * Destroys the buffer.
+		 *
+		 * @remarks The buffer is not deleted right away, it is handed to the deletion_queue which
+		 *          deletes it once the GPU has finished the frame it was last used in.
+		 */
+		~buffer()
+		{
+			this->release();
+		}
+
 		/**
 		 * Updates the data stored in the buffer with new data.
 		 *
@@ -57,6 +128,12 @@ namespace buffer
 		 */
 		void update(void *data)
 		{
+			if (direct_state_access())
+			{
+				glNamedBufferSubData(buffer_id, 0, size, data);
+				return;
+			}
+
 			this->bind([&]() {
 				glBufferSubData(static_cast<int>(_buffer_type), 0, size, data);
 			});
@@ -67,22 +144,156 @@ namespace buffer
 		 *
 		 * @param new_size  The new size (in bytes) of the buffer.
 		 *
-		 * @remarks This function resizes the buffer using glBufferData. If the new size is larger than
-		 *          the current size, the buffer will be reallocated. If the new size is smaller, the
-		 *          existing data will be truncated. Resizing the buffer should be done sparingly, as it
-		 *          can be an expensive operation.
+		 * @remarks This function resizes the buffer using glBufferData, which reallocates the buffer
+		 *          and discards its existing contents. Use grow or reserve to keep the contents.
+		 *          Resizing the buffer should be done sparingly, as it can be an expensive operation.
 		 */
 		void resize(int new_size)
 		{
 			// if (size <= new_size)
 			{
-				this->bind([&]() {
-					glBufferData(static_cast<int>(_buffer_type), new_size, nullptr, static_cast<int>(_draw_type));
-				});
+				if (direct_state_access())
+				{
+					glNamedBufferData(buffer_id, new_size, nullptr, static_cast<int>(_draw_type));
+				}
+				else
+				{
+					this->bind([&]() {
+						glBufferData(static_cast<int>(_buffer_type), new_size, nullptr, static_cast<int>(_draw_type));
+					});
+				}
 				size = new_size;
 			}
 		}
 
+		/**
+		 * Resizes the buffer to a new size while keeping its contents.
+		 *
+		 * @param new_size  The new size (in bytes) of the buffer.
+		 *
+		 * @remarks This function allocates a new buffer and copies the old contents into it on the GPU
+		 *          using glCopyBufferSubData, so nothing has to be uploaded again. If the new size is
+		 *          smaller, the contents are truncated. As the buffer gets a new ID, any vertex array
+		 *          or indexed binding that refers to the old buffer has to be set up again. A pending
+		 *          shader write to the old buffer is made visible to the copy first, and is carried over
+		 *          to the new one for later reads.
+		 */
+		void grow(int new_size)
+		{
+			GLuint old_id = buffer_id;
+			int copy_size = std::min(size, new_size);
+
+			gfx::barrier_tracker &tracker = gfx::barrier_tracker::get();
+			tracker.require({ gfx::buffer_resource(old_id), gfx::access::update, false });
+			tracker.flush();
+
+			if (direct_state_access())
+			{
+				glCreateBuffers(1, &buffer_id);
+				glNamedBufferData(buffer_id, new_size, nullptr, static_cast<int>(_draw_type));
+				glCopyNamedBufferSubData(old_id, buffer_id, 0, 0, copy_size);
+			}
+			else
+			{
+				glGenBuffers(1, &buffer_id);
+
+				glBindBuffer(GL_COPY_READ_BUFFER, old_id);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+				glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, static_cast<int>(_draw_type));
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, copy_size);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			}
+
+			tracker.replace(gfx::buffer_resource(old_id), gfx::buffer_resource(buffer_id));
+
+			deletion_queue::get().created();
+			deletion_queue::get().destroy(old_id);
+
+			size = new_size;
+			used = std::min(used, new_size);
+		}
+
+		/**
+		 * Copies a portion of this buffer into another buffer on the GPU.
+		 *
+		 * @param destination         The ID of the buffer to copy into.
+		 * @param source_offset       The offset (in bytes) to copy from in this buffer.
+		 * @param destination_offset  The offset (in bytes) to copy to in the destination buffer.
+		 * @param data_size           The size (in bytes) of the data to copy.
+		 *
+		 * @remarks This uses glCopyBufferSubData, so the data never goes through the CPU.
+		 */
+		void copy_to(GLuint destination, int source_offset, int destination_offset, int data_size)
+		{
+			if (direct_state_access())
+			{
+				glCopyNamedBufferSubData(buffer_id, destination, source_offset, destination_offset, data_size);
+				return;
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer_id);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source_offset, destination_offset, data_size);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+
+		/**
+		 * Makes sure the buffer is at least the given size, growing it geometrically if it is not.
+		 *
+		 * @param required_size  The minimum size (in bytes) the buffer needs to have.
+		 *
+		 * @remarks The buffer grows to at least "size * growth_factor", so a sequence of appends only
+		 *          reallocates a logarithmic number of times, making each append amortized O(1). The
+		 *          contents are kept, see grow.
+		 */
+		void reserve(int required_size)
+		{
+			if (required_size <= size)
+			{
+				return;
+			}
+
+			int grown_size = static_cast<int>(static_cast<float>(size) * growth_factor);
+			this->grow(std::max(required_size, grown_size));
+		}
+
+		/**
+		 * Writes data after the last appended data, growing the buffer if needed.
+		 *
+		 * @param data        A pointer to the data that will be written into the buffer.
+		 * @param data_size   The size (in bytes) of the data to be written.
+		 *
+		 * @return The offset (in bytes) the data was written to.
+		 */
+		int append(void *data, int data_size)
+		{
+			int offset = used;
+
+			this->reserve(used + data_size);
+			this->write(data, data_size, offset);
+			used += data_size;
+
+			return offset;
+		}
+
+		/**
+		 * Resets the append position to the start of the buffer, without touching its contents.
+		 */
+		void clear()
+		{
+			used = 0;
+		}
+
+		/**
+		 * Sets the factor the buffer grows by in reserve and append. Defaults to 2.
+		 */
+		void set_growth_factor(float factor)
+		{
+			growth_factor = factor;
+		}
+
 		/**
 		 * Writes a portion of data into the buffer at the specified offset.
 		 *
@@ -95,6 +306,12 @@ namespace buffer
 		 */
 		void write(void *data, int data_size, int offset)
 		{
+			if (direct_state_access())
+			{
+				glNamedBufferSubData(buffer_id, offset, data_size, data);
+				return;
+			}
+
 			this->bind([&]() {
 				glBufferSubData(static_cast<int>(_buffer_type), offset, data_size, data);
 			});
@@ -107,9 +324,11 @@ namespace buffer
 		 *
 		 * @remarks This function binds the buffer using glBindBuffer, executes the provided callback
 		 *          function, and then unbinds the buffer. It ensures that the buffer is bound before
-		 *          performing any operations on it.
+		 *          performing any operations on it. The callback is taken as a template parameter so
+		 *          it is never type-erased or heap allocated.
 		 */
-		void bind(std::function<void()> callback)
+		template<typename F>
+		void bind(F &&callback)
 		{
 			glBindBuffer(static_cast<int>(_buffer_type), buffer_id);
 			callback();
@@ -152,6 +371,48 @@ namespace buffer
 			glBindBufferBase(GL_UNIFORM_BUFFER, *binding, buffer_id);
 		}
 
+		/**
+		 * Binds the buffer as the draw indirect buffer (GL_DRAW_INDIRECT_BUFFER), which indirect draw
+		 * calls read their commands from.
+		 */
+		void bind_indirect()
+		{
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer_id);
+		}
+
+		/**
+		 * Binds the buffer as the dispatch indirect buffer (GL_DISPATCH_INDIRECT_BUFFER), which
+		 * glDispatchComputeIndirect reads its group counts from.
+		 */
+		void bind_dispatch_indirect()
+		{
+			glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer_id);
+		}
+
+		/**
+		 * Binds the buffer to an indexed binding point of its own buffer type, e.g. a shader storage
+		 * or uniform block binding.
+		 *
+		 * @param binding  The binding point index.
+		 */
+		void bind_base(GLuint binding)
+		{
+			glBindBufferBase(static_cast<int>(_buffer_type), binding, buffer_id);
+		}
+
+		/**
+		 * Binds a range of the buffer to an indexed binding point of its own buffer type.
+		 *
+		 * @param binding  The binding point index.
+		 * @param offset   The offset (in bytes) of the range. For uniform buffers this has to be a
+		 *                 multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT.
+		 * @param size     The size (in bytes) of the range.
+		 */
+		void bind_range(GLuint binding, int offset, int size)
+		{
+			glBindBufferRange(static_cast<int>(_buffer_type), binding, buffer_id, offset, size);
+		}
+
 		/**
 		 * Returns the size (in bytes) of the data stored in the buffer.
 		 *
@@ -162,11 +423,35 @@ namespace buffer
 			return size;
 		}
 
+		GLuint get_id()
+		{
+			return buffer_id;
+		}
+
+		/**
+		 * Returns the number of bytes written using append.
+		 */
+		int get_used()
+		{
+			return used;
+		}
+
 	private:
-		GLuint buffer_id;
+		GLuint buffer_id = 0;
 		draw_type _draw_type;
 		buffer_type _buffer_type;
 		int size;
+		int used = 0;
+		float growth_factor = 2.0f;
+
+		void release()
+		{
+			if (buffer_id != 0)
+			{
+				deletion_queue::get().destroy(buffer_id);
+				buffer_id = 0;
+			}
+		}
 	};
 
 	typedef std::unique_ptr<buffer> unique_buffer;
@@ -193,3 +478,25 @@ namespace buffer
 		return id;
 	}
 }
+
+namespace gfx
+{
+	/**
+	 * Declares that a buffer is read, e.g. as vertices, indirect commands or a storage buffer.
+	 */
+	inline resource_use reads(buffer::buffer &buffer, access usage)
+	{
+		return { buffer_resource(buffer.get_id()), usage, false };
+	}
+
+	/**
+	 * Declares that a buffer is written by a shader, through a storage buffer binding.
+	 *
+	 * @remarks A write is checked like a storage read, so writing over an earlier shader write is
+	 *          ordered after it as well.
+	 */
+	inline resource_use writes(buffer::buffer &buffer)
+	{
+		return { buffer_resource(buffer.get_id()), access::storage, true };
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <buffer.hpp>
+#include <heap.hpp>
+#include <render.hpp>
+#include <vector>
+
+namespace gfx
+{
+	/**
+	 * The layout glMultiDrawElementsIndirect expects for every draw in the indirect buffer.
+	 */
+	struct draw_elements_indirect_command {
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	/**
+	 * Collects indexed draws and submits them all with a single glMultiDrawElementsIndirect.
+	 *
+	 * @tparam T  The per-draw data (model matrix, material index, ...), uploaded into a shader storage
+	 *            buffer. It has to follow the std430 layout rules of the matching GLSL struct.
+	 *
+	 * @remarks Draw "i" reads its data at index "i" of the storage buffer, which can be done with
+	 *          gl_DrawID (OpenGL 4.6 or ARB_shader_draw_parameters). The base instance of every command
+	 *          is set to the same index, so gl_BaseInstance or an instanced attribute work as well. All
+	 *          draws share the currently bound vertex array and element buffer, which makes this a
+	 *          natural fit for meshes living in a buffer::heap.
+	 */
+	template<typename T>
+	class command_list
+	{
+	public:
+		/**
+		 * @param storage_binding  The shader storage binding the per-draw data is bound to.
+		 * @param draw_capacity    The number of draws to preallocate GPU memory for.
+		 */
+		command_list(GLuint storage_binding = 0, int draw_capacity = 1024)
+			: storage_binding { storage_binding }
+			, command_buffer(nullptr, draw_capacity * sizeof(draw_elements_indirect_command), draw_type::stream_draw, buffer_type::draw_indirect)
+			, storage_buffer(nullptr, draw_capacity * sizeof(T), draw_type::stream_draw, buffer_type::shader_storage)
+		{
+		}
+
+		/**
+		 * Adds an indexed draw.
+		 *
+		 * @param index_count     The number of indices to draw.
+		 * @param first_index     The first index, in indices.
+		 * @param base_vertex     The value added to every index before fetching the vertex.
+		 * @param data            The per-draw data.
+		 * @param instance_count  The number of instances to draw.
+		 */
+		void add(int index_count, int first_index, int base_vertex, const T &data, int instance_count = 1)
+		{
+			commands.push_back({
+				static_cast<GLuint>(index_count),
+				static_cast<GLuint>(instance_count),
+				static_cast<GLuint>(first_index),
+				base_vertex,
+				static_cast<GLuint>(draw_data.size()),
+			});
+
+			draw_data.push_back(data);
+		}
+
+		void add(const buffer::mesh_handle &mesh, const T &data, int instance_count = 1)
+		{
+			this->add(mesh.index_count(), mesh.first_index(), mesh.base_vertex(), data, instance_count);
+		}
+
+		/**
+		 * Uploads the collected commands and per-draw data and draws them all in one call.
+		 *
+		 * @remarks The vertex array, element buffer and program have to be bound beforehand. The list
+		 *          is not cleared, so a static list can be submitted again every frame.
+		 */
+		void submit()
+		{
+			if (commands.empty())
+			{
+				return;
+			}
+
+			upload(command_buffer, commands.data(), commands.size() * sizeof(draw_elements_indirect_command));
+			upload(storage_buffer, draw_data.data(), draw_data.size() * sizeof(T));
+
+			storage_buffer.bind_base(storage_binding);
+			command_buffer.bind_indirect();
+
+			gfx::multi_draw_elements_indirect(static_cast<int>(commands.size()));
+		}
+
+		void clear()
+		{
+			commands.clear();
+			draw_data.clear();
+		}
+
+		size_t size() const
+		{
+			return commands.size();
+		}
+
+	private:
+		GLuint storage_binding;
+
+		std::vector<draw_elements_indirect_command> commands;
+		std::vector<T> draw_data;
+
+		buffer::buffer command_buffer;
+		buffer::buffer storage_buffer;
+
+		static void upload(buffer::buffer &target, void *data, size_t size)
+		{
+			int bytes = static_cast<int>(size);
+
+			// the whole buffer is rewritten, so there is no point in keeping the old contents
+			if (bytes > target.get_size())
+			{
+				target.resize(std::max(bytes, target.get_size() * 2));
+			}
+
+			target.write(data, bytes, 0);
+		}
+	};
+}
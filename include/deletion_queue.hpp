@@ -0,0 +1,132 @@
+#pragma once
+#include <GL/glew.h>
+#include <deque>
+#include <vector>
+
+namespace buffer
+{
+	/**
+	 * Delays deleting buffers until the GPU is done with them.
+	 *
+	 * @remarks Buffers destroyed during a frame are collected, and a fence is placed after the last
+	 *          command of that frame in end_frame. Only once that fence has signalled are the names
+	 *          actually deleted, so the driver never has to stall on a buffer that is still in use.
+	 *          end_frame is called by frame::framework after every frame.
+	 */
+	class deletion_queue
+	{
+	public:
+		static deletion_queue &get()
+		{
+			static deletion_queue queue;
+			return queue;
+		}
+
+		deletion_queue(const deletion_queue &) = delete;
+		deletion_queue &operator=(const deletion_queue &) = delete;
+
+		/**
+		 * Records that a buffer was created, for the live object count.
+		 */
+		void created()
+		{
+			live++;
+		}
+
+		/**
+		 * Queues a buffer for deletion once the current frame has finished on the GPU.
+		 *
+		 * @param id  The name of the buffer. It must not be used by the caller afterwards.
+		 */
+		void destroy(GLuint id)
+		{
+			live--;
+			current.push_back(id);
+		}
+
+		/**
+		 * Fences the buffers destroyed this frame and deletes the ones whose fence has signalled.
+		 * This never blocks.
+		 */
+		void end_frame()
+		{
+			if (!current.empty())
+			{
+				frames.push_back({ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), std::move(current) });
+				current.clear();
+			}
+
+			while (!frames.empty())
+			{
+				GLenum status = glClientWaitSync(frames.front().fence, 0, 0);
+
+				if (status == GL_TIMEOUT_EXPIRED)
+				{
+					break;
+				}
+
+				release(frames.front());
+				frames.pop_front();
+			}
+		}
+
+		/**
+		 * Deletes every queued buffer right away, e.g. before the context is destroyed.
+		 */
+		void flush()
+		{
+			glFinish();
+
+			for (frame &pending : frames)
+			{
+				release(pending);
+			}
+
+			frames.clear();
+
+			glDeleteBuffers(static_cast<GLsizei>(current.size()), current.data());
+			current.clear();
+		}
+
+		/**
+		 * Returns the number of buffers that have been created and not destroyed yet.
+		 */
+		int live_count() const
+		{
+			return live;
+		}
+
+		/**
+		 * Returns the number of destroyed buffers still waiting for the GPU before being deleted.
+		 */
+		int pending_count() const
+		{
+			int pending = static_cast<int>(current.size());
+
+			for (const frame &queued : frames)
+			{
+				pending += static_cast<int>(queued.names.size());
+			}
+
+			return pending;
+		}
+
+	private:
+		struct frame {
+			GLsync fence;
+			std::vector<GLuint> names;
+		};
+
+		int live = 0;
+		std::vector<GLuint> current;
+		std::deque<frame> frames;
+
+		deletion_queue() = default;
+
+		static void release(frame &pending)
+		{
+			glDeleteSync(pending.fence);
+			glDeleteBuffers(static_cast<GLsizei>(pending.names.size()), pending.names.data());
+		}
+	};
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <hash.hpp>
+#include <string_view>
+
+namespace shader
+{
+	/**
+	 * A shader source compiled into the binary by meowfu_embed_shaders (see cmake/EmbedShaders.cmake).
+	 *
+	 * @remarks "hash" is the FNV-1a hash of "code", computed at compile time. It is the same value
+	 *          hashing the file's contents at runtime would give, so embedded and file based programs
+	 *          share program cache entries.
+	 */
+	struct embedded_source {
+		std::string_view name;
+		std::string_view code;
+		uint64_t hash;
+	};
+}
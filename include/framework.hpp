@@ -1,5 +1,9 @@
 #pragma once
+#include <barrier.hpp>
+#include <deletion_queue.hpp>
+#include <gpu_profiler.hpp>
 #include <input.hpp>
+#include <uniform_table.hpp>
 #include <window.hpp>
 
 #include "GLFW/glfw3.h"
@@ -171,6 +175,7 @@ namespace frame
 				do
 				{
 					context->poll_events();
+					gfx::gpu_profiler::get().begin_frame();
 
 					double currentTime = glfwGetTime();
 					frame.deltaTime = float(currentTime - frame.lastTime);
@@ -191,7 +196,13 @@ namespace frame
 					}
 
 					frame.lastTime = currentTime;
+
+					gfx::gpu_profiler::get().end_frame();
 					context->swap_buffers();
+
+					buffer::deletion_queue::get().end_frame();
+					shader::uniform_stats::get().end_frame();
+					gfx::barrier_tracker::get().end_frame();
 				} while (glfwWindowShouldClose(window) == 0);
 			});
 		}
@@ -0,0 +1,297 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <hash.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx
+{
+	/**
+	 * The GPU time of a single zone in a resolved frame.
+	 *
+	 * @remarks Zones are stored in the order they were opened, so a child always follows its parent and
+	 *          "depth" is enough to draw the hierarchy. "average" is taken over the last
+	 *          gpu_profiler::window frames the zone appeared in.
+	 */
+	struct gpu_zone {
+		std::string name;
+		int depth;
+		float milliseconds;
+		float average;
+	};
+
+	/**
+	 * Measures how long zones of GPU work take, e.g. passes, draws or dispatches.
+	 *
+	 * @remarks Each zone writes a GL_TIMESTAMP query when it opens and when it closes, so zones can be
+	 *          nested freely (unlike GL_TIME_ELAPSED queries). Queries are recorded into one of several
+	 *          frame slots, and a slot is only read once all of its results are available, a few frames
+	 *          later, so reading the timings never stalls. If the GPU falls so far behind that the next
+	 *          slot is still unresolved, that frame is not recorded. begin_frame and end_frame are
+	 *          called by frame::framework, which also wraps every frame in a "frame" zone.
+	 */
+	class gpu_profiler
+	{
+	public:
+		static constexpr int slots = 4;
+		static constexpr int window = 64;
+
+		static gpu_profiler &get()
+		{
+			static gpu_profiler profiler;
+			return profiler;
+		}
+
+		gpu_profiler(const gpu_profiler &) = delete;
+		gpu_profiler &operator=(const gpu_profiler &) = delete;
+
+		/**
+		 * Enables or disables profiling, starting with the next frame.
+		 */
+		void set_enabled(bool enabled)
+		{
+			requested = enabled;
+		}
+
+		bool is_enabled() const
+		{
+			return requested;
+		}
+
+		/**
+		 * Starts recording a frame into the next free slot, and opens the "frame" zone.
+		 */
+		void begin_frame()
+		{
+			frame_slot &slot = frames[current];
+
+			recording = requested && !slot.pending;
+			depth = 0;
+
+			if (recording)
+			{
+				slot.used = 0;
+				slot.records.clear();
+			}
+
+			this->begin("frame");
+		}
+
+		/**
+		 * Closes the "frame" zone, and resolves every earlier frame whose results have arrived. This
+		 * never blocks.
+		 */
+		void end_frame()
+		{
+			if (depth != 1)
+			{
+				throw std::runtime_error("gpu profiler zone left open at the end of the frame");
+			}
+
+			this->end();
+
+			if (recording)
+			{
+				frames[current].pending = true;
+				current = (current + 1) % slots;
+			}
+
+			// the oldest pending frame is the one about to be recorded over, so resolving starts there
+			for (int i = 0; i < slots; i++)
+			{
+				frame_slot &slot = frames[(current + i) % slots];
+
+				if (slot.pending && !this->resolve(slot))
+				{
+					// later frames can't have finished before this one
+					break;
+				}
+			}
+		}
+
+		/**
+		 * Opens a zone, nested in the zone that is currently open. Prefer gpu_scope.
+		 */
+		void begin(std::string_view name)
+		{
+			depth++;
+
+			if (!recording)
+			{
+				return;
+			}
+
+			int parent = depth > 1 ? open[depth - 2] : -1;
+			frame_slot &slot = frames[current];
+			uint64_t key = hash::fnv1a(name, parent >= 0 ? slot.records[parent].key : hash::fnv_offset);
+
+			slot.records.push_back({ std::string(name), key, depth - 1, this->timestamp(slot), 0 });
+
+			if (open.size() < static_cast<size_t>(depth))
+			{
+				open.resize(depth);
+			}
+
+			open[depth - 1] = static_cast<int>(slot.records.size()) - 1;
+		}
+
+		/**
+		 * Closes the innermost open zone.
+		 */
+		void end()
+		{
+			if (depth == 0)
+			{
+				throw std::runtime_error("gpu profiler zone closed without being opened");
+			}
+
+			depth--;
+
+			if (!recording)
+			{
+				return;
+			}
+
+			frame_slot &slot = frames[current];
+			slot.records[open[depth]].end = this->timestamp(slot);
+		}
+
+		/**
+		 * Returns the zones of the most recently resolved frame.
+		 */
+		const std::vector<gpu_zone> &get_zones() const
+		{
+			return zones;
+		}
+
+		/**
+		 * Returns the GPU time (in milliseconds) of the most recently resolved frames, oldest first.
+		 */
+		const std::vector<float> &get_frame_history() const
+		{
+			return history;
+		}
+
+	private:
+		struct record {
+			std::string name;
+			uint64_t key;
+			int depth;
+			int begin;
+			int end;
+		};
+
+		struct frame_slot {
+			std::vector<GLuint> queries;
+			int used = 0;
+			std::vector<record> records;
+			bool pending = false;
+		};
+
+		struct rolling {
+			std::array<float, window> samples {};
+			int count = 0;
+			int next = 0;
+			float sum = 0.0f;
+
+			float push(float value)
+			{
+				sum += value - samples[next];
+				samples[next] = value;
+				next = (next + 1) % window;
+				count = count < window ? count + 1 : window;
+
+				return sum / count;
+			}
+		};
+
+		std::array<frame_slot, slots> frames;
+		int current = 0;
+
+		bool requested = false;
+		bool recording = false;
+		int depth = 0;
+		std::vector<int> open;
+
+		std::vector<gpu_zone> zones;
+		std::vector<float> history = std::vector<float>(128, 0.0f);
+		std::unordered_map<uint64_t, rolling> averages;
+
+		gpu_profiler() = default;
+
+		int timestamp(frame_slot &slot)
+		{
+			if (slot.used == static_cast<int>(slot.queries.size()))
+			{
+				size_t grown = std::max<size_t>(slot.queries.size() * 2, 32);
+				size_t previous = slot.queries.size();
+
+				slot.queries.resize(grown);
+				glGenQueries(static_cast<GLsizei>(grown - previous), slot.queries.data() + previous);
+			}
+
+			glQueryCounter(slot.queries[slot.used], GL_TIMESTAMP);
+			return slot.used++;
+		}
+
+		bool resolve(frame_slot &slot)
+		{
+			GLint available = GL_FALSE;
+			glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (available != GL_TRUE)
+			{
+				return false;
+			}
+
+			std::vector<GLuint64> times(slot.used);
+
+			for (int i = 0; i < slot.used; i++)
+			{
+				glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &times[i]);
+			}
+
+			zones.clear();
+
+			for (const record &zone : slot.records)
+			{
+				float milliseconds = static_cast<float>(times[zone.end] - times[zone.begin]) / 1'000'000.0f;
+				zones.push_back({ zone.name, zone.depth, milliseconds, averages[zone.key].push(milliseconds) });
+			}
+
+			history.erase(history.begin());
+			history.push_back(zones.front().milliseconds);
+
+			slot.pending = false;
+			return true;
+		}
+	};
+
+	/**
+	 * Measures the GPU time of the commands issued during its lifetime, e.g.
+	 *
+	 *     gfx::gpu_scope zone("shadows");
+	 */
+	class gpu_scope
+	{
+	public:
+		gpu_scope(std::string_view name)
+		{
+			gpu_profiler::get().begin(name);
+		}
+
+		gpu_scope(const gpu_scope &) = delete;
+		gpu_scope &operator=(const gpu_scope &) = delete;
+
+		~gpu_scope()
+		{
+			gpu_profiler::get().end();
+		}
+	};
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace hash
+{
+	constexpr uint64_t fnv_offset = 0xcbf29ce484222325ull;
+	constexpr uint64_t fnv_prime = 0x100000001b3ull;
+
+	/**
+	 * Hashes a string using 64 bit FNV-1a.
+	 *
+	 * @remarks This is constexpr, so hashing a string literal costs nothing at runtime. Hashes computed
+	 *          at compile time and at runtime are identical, so they can be mixed freely.
+	 */
+	constexpr uint64_t fnv1a(std::string_view data, uint64_t seed = fnv_offset)
+	{
+		uint64_t value = seed;
+
+		for (char c : data)
+		{
+			value ^= static_cast<uint8_t>(c);
+			value *= fnv_prime;
+		}
+
+		return value;
+	}
+
+	inline uint64_t fnv1a(const void *data, size_t size, uint64_t seed = fnv_offset)
+	{
+		return fnv1a(std::string_view(static_cast<const char *>(data), size), seed);
+	}
+
+	constexpr uint64_t combine(uint64_t seed, uint64_t value)
+	{
+		return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+	}
+}
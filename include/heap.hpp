@@ -0,0 +1,508 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <buffer.hpp>
+#include <cstdint>
+#include <render.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace buffer
+{
+	/**
+	 * A range handed out by an offset_allocator. Offsets and sizes are in allocator units, which are
+	 * whatever the owner decides (bytes, vertices, indices, ...).
+	 */
+	struct allocation {
+		static constexpr uint32_t none = 0xffffffff;
+
+		uint32_t offset = none;
+		uint32_t size = 0;
+		uint32_t node = none;
+
+		bool valid() const
+		{
+			return node != none;
+		}
+	};
+
+	struct storage_report {
+		uint32_t total_free;
+		uint32_t largest_free;
+		uint32_t free_ranges;
+
+		/**
+		 * Returns how fragmented the free space is, from 0 (one contiguous free range) to 1.
+		 */
+		float fragmentation() const
+		{
+			return total_free == 0 ? 0.0f : 1.0f - static_cast<float>(largest_free) / static_cast<float>(total_free);
+		}
+	};
+
+	/**
+	 * A two-level segregated fit (TLSF) allocator managing offsets into a range of "capacity" units.
+	 *
+	 * @remarks The allocator never touches GPU memory itself, it only hands out offsets. Free ranges
+	 *          are kept in size-class bins (an exponent and a 3 bit mantissa), and two levels of bitmasks
+	 *          are used to find a non-empty bin, so both allocate and free run in O(1). Freed ranges are
+	 *          merged with their free neighbours right away.
+	 */
+	class offset_allocator
+	{
+	public:
+		offset_allocator(uint32_t capacity)
+			: capacity { capacity }
+		{
+			bin_heads.fill(none);
+			used_bins.fill(0);
+
+			if (capacity > 0)
+			{
+				insert_free(0, capacity);
+			}
+		}
+
+		/**
+		 * Allocates a contiguous range.
+		 *
+		 * @param size  The size of the range, in allocator units.
+		 *
+		 * @return The allocation, or an invalid allocation if no free range is large enough.
+		 */
+		allocation allocate(uint32_t size)
+		{
+			if (size == 0)
+			{
+				return {};
+			}
+
+			uint32_t min_bin = bin_round_up(size);
+			uint32_t top = min_bin >> mantissa_bits;
+			uint32_t bin = none;
+
+			if (used_bins_top & (1u << top))
+			{
+				uint32_t leaf = lowest_bit_after(used_bins[top], min_bin & mantissa_mask);
+				if (leaf != none)
+				{
+					bin = (top << mantissa_bits) | leaf;
+				}
+			}
+
+			if (bin == none)
+			{
+				top = lowest_bit_after(used_bins_top, top + 1);
+				if (top == none)
+				{
+					return {};
+				}
+
+				bin = (top << mantissa_bits) | std::countr_zero(used_bins[top]);
+			}
+
+			uint32_t index = bin_heads[bin];
+			uint32_t total = nodes[index].size;
+
+			unlink_bin(index);
+
+			nodes[index].size = size;
+			nodes[index].used = true;
+			free_storage -= total;
+
+			if (total > size)
+			{
+				uint32_t remainder = insert_free(nodes[index].offset + size, total - size);
+
+				nodes[remainder].neighbor_prev = index;
+				nodes[remainder].neighbor_next = nodes[index].neighbor_next;
+
+				if (nodes[index].neighbor_next != none)
+				{
+					nodes[nodes[index].neighbor_next].neighbor_prev = remainder;
+				}
+
+				nodes[index].neighbor_next = remainder;
+			}
+
+			return allocation { nodes[index].offset, size, index };
+		}
+
+		/**
+		 * Frees a previously allocated range, merging it with any free neighbouring ranges.
+		 *
+		 * @param alloc  The allocation returned by allocate.
+		 */
+		void free(const allocation &alloc)
+		{
+			if (!alloc.valid())
+			{
+				return;
+			}
+
+			uint32_t index = alloc.node;
+			uint32_t offset = nodes[index].offset;
+			uint32_t size = nodes[index].size;
+			uint32_t prev = nodes[index].neighbor_prev;
+			uint32_t next = nodes[index].neighbor_next;
+
+			if (prev != none && !nodes[prev].used)
+			{
+				offset = nodes[prev].offset;
+				size += nodes[prev].size;
+
+				uint32_t before = nodes[prev].neighbor_prev;
+				remove_free(prev);
+				prev = before;
+			}
+
+			if (next != none && !nodes[next].used)
+			{
+				size += nodes[next].size;
+
+				uint32_t after = nodes[next].neighbor_next;
+				remove_free(next);
+				next = after;
+			}
+
+			release_node(index);
+
+			uint32_t merged = insert_free(offset, size);
+
+			nodes[merged].neighbor_prev = prev;
+			nodes[merged].neighbor_next = next;
+
+			if (prev != none)
+			{
+				nodes[prev].neighbor_next = merged;
+			}
+
+			if (next != none)
+			{
+				nodes[next].neighbor_prev = merged;
+			}
+		}
+
+		/**
+		 * Returns a summary of the free space, including the largest free range.
+		 *
+		 * @remarks Unlike allocate and free this walks every free range, so it is meant for diagnostics
+		 *          rather than for the hot path.
+		 */
+		storage_report report() const
+		{
+			storage_report report { free_storage, 0, 0 };
+
+			for (uint32_t bin = 0; bin < bin_count; bin++)
+			{
+				for (uint32_t index = bin_heads[bin]; index != none; index = nodes[index].bin_next)
+				{
+					report.largest_free = std::max(report.largest_free, nodes[index].size);
+					report.free_ranges++;
+				}
+			}
+
+			return report;
+		}
+
+		uint32_t get_capacity() const
+		{
+			return capacity;
+		}
+
+	private:
+		static constexpr uint32_t none = allocation::none;
+		static constexpr uint32_t mantissa_bits = 3;
+		static constexpr uint32_t mantissa_value = 1u << mantissa_bits;
+		static constexpr uint32_t mantissa_mask = mantissa_value - 1;
+		static constexpr uint32_t top_bin_count = 32;
+		static constexpr uint32_t bin_count = top_bin_count * mantissa_value;
+
+		struct node {
+			uint32_t offset = 0;
+			uint32_t size = 0;
+			uint32_t bin_prev = none;
+			uint32_t bin_next = none;
+			uint32_t neighbor_prev = none;
+			uint32_t neighbor_next = none;
+			bool used = false;
+		};
+
+		uint32_t capacity;
+		uint32_t free_storage = 0;
+
+		uint32_t used_bins_top = 0;
+		std::array<uint8_t, top_bin_count> used_bins;
+		std::array<uint32_t, bin_count> bin_heads;
+
+		std::vector<node> nodes;
+		std::vector<uint32_t> free_nodes;
+
+		static uint32_t bin_round_down(uint32_t size)
+		{
+			if (size < mantissa_value)
+			{
+				return size;
+			}
+
+			uint32_t shift = std::bit_width(size) - 1 - mantissa_bits;
+			return ((shift + 1) << mantissa_bits) + ((size >> shift) & mantissa_mask);
+		}
+
+		static uint32_t bin_round_up(uint32_t size)
+		{
+			if (size < mantissa_value)
+			{
+				return size;
+			}
+
+			uint32_t shift = std::bit_width(size) - 1 - mantissa_bits;
+			uint32_t bin = ((shift + 1) << mantissa_bits) + ((size >> shift) & mantissa_mask);
+
+			// any bits below the mantissa mean the size is larger than the bin's lower bound,
+			// the carry into the exponent is intentional.
+			return (size & ((1u << shift) - 1)) != 0 ? bin + 1 : bin;
+		}
+
+		static uint32_t lowest_bit_after(uint32_t mask, uint32_t start)
+		{
+			if (start >= 32)
+			{
+				return none;
+			}
+
+			uint32_t remaining = mask & ~((1u << start) - 1);
+			return remaining == 0 ? none : std::countr_zero(remaining);
+		}
+
+		uint32_t acquire_node()
+		{
+			if (!free_nodes.empty())
+			{
+				uint32_t index = free_nodes.back();
+				free_nodes.pop_back();
+
+				nodes[index] = node {};
+				return index;
+			}
+
+			nodes.emplace_back();
+			return static_cast<uint32_t>(nodes.size() - 1);
+		}
+
+		void release_node(uint32_t index)
+		{
+			free_nodes.push_back(index);
+		}
+
+		uint32_t insert_free(uint32_t offset, uint32_t size)
+		{
+			uint32_t bin = bin_round_down(size);
+			uint32_t top = bin >> mantissa_bits;
+
+			used_bins_top |= 1u << top;
+			used_bins[top] |= 1u << (bin & mantissa_mask);
+
+			uint32_t index = acquire_node();
+
+			nodes[index].offset = offset;
+			nodes[index].size = size;
+			nodes[index].bin_next = bin_heads[bin];
+
+			if (bin_heads[bin] != none)
+			{
+				nodes[bin_heads[bin]].bin_prev = index;
+			}
+
+			bin_heads[bin] = index;
+			free_storage += size;
+
+			return index;
+		}
+
+		void unlink_bin(uint32_t index)
+		{
+			node &entry = nodes[index];
+
+			if (entry.bin_prev != none)
+			{
+				nodes[entry.bin_prev].bin_next = entry.bin_next;
+			}
+
+			if (entry.bin_next != none)
+			{
+				nodes[entry.bin_next].bin_prev = entry.bin_prev;
+			}
+
+			uint32_t bin = bin_round_down(entry.size);
+
+			if (bin_heads[bin] == index)
+			{
+				bin_heads[bin] = entry.bin_next;
+
+				if (bin_heads[bin] == none)
+				{
+					uint32_t top = bin >> mantissa_bits;
+
+					used_bins[top] &= ~(1u << (bin & mantissa_mask));
+
+					if (used_bins[top] == 0)
+					{
+						used_bins_top &= ~(1u << top);
+					}
+				}
+			}
+
+			entry.bin_prev = none;
+			entry.bin_next = none;
+		}
+
+		void remove_free(uint32_t index)
+		{
+			unlink_bin(index);
+			free_storage -= nodes[index].size;
+			release_node(index);
+		}
+	};
+
+	/**
+	 * A mesh living inside a heap. Vertex offsets are in vertices and index offsets are in indices,
+	 * so they can be passed straight to the base-vertex draw calls.
+	 */
+	struct mesh_handle {
+		allocation vertices;
+		allocation indices;
+
+		int base_vertex() const
+		{
+			return static_cast<int>(vertices.offset);
+		}
+
+		int first_index() const
+		{
+			return static_cast<int>(indices.offset);
+		}
+
+		int index_count() const
+		{
+			return static_cast<int>(indices.size);
+		}
+	};
+
+	/**
+	 * Shares one large vertex buffer and one large element buffer between many meshes.
+	 *
+	 * @remarks Every mesh gets a vertex and index range carved out of the shared buffers using an
+	 *          offset_allocator, so a whole scene can be drawn with a single vertex array and buffer
+	 *          binding. Indices are 32 bit and relative to the mesh, the base vertex is applied at
+	 *          draw time.
+	 */
+	class heap
+	{
+	public:
+		/**
+		 * Creates the shared vertex and index buffers.
+		 *
+		 * @param vertex_capacity  The maximum number of vertices across all meshes.
+		 * @param index_capacity   The maximum number of indices across all meshes.
+		 * @param vertex_stride    The size (in bytes) of a single vertex.
+		 * @param type             The type of drawing operations that will be performed with the buffers.
+		 */
+		heap(int vertex_capacity, int index_capacity, int vertex_stride, draw_type type = draw_type::static_draw)
+			: vertex_stride { vertex_stride }
+			, vertex_allocator(vertex_capacity)
+			, index_allocator(index_capacity)
+			, vertex_buffer(nullptr, vertex_capacity * vertex_stride, type, buffer_type::array)
+			, index_buffer(nullptr, index_capacity * static_cast<int>(sizeof(uint32_t)), type, buffer_type::element_array)
+		{
+		}
+
+		/**
+		 * Allocates space for a mesh and uploads its vertices and indices.
+		 *
+		 * @param vertices      A pointer to the vertex data, "vertex_count * vertex_stride" bytes long.
+		 * @param vertex_count  The number of vertices.
+		 * @param indices       A pointer to the 32 bit index data, relative to the first vertex of the mesh.
+		 * @param index_count   The number of indices, 0 for a mesh without indices (e.g. drawn with glDrawArrays).
+		 *
+		 * @return A handle to the mesh, which must be passed to free once the mesh is no longer needed.
+		 */
+		mesh_handle allocate(void *vertices, int vertex_count, void *indices = nullptr, int index_count = 0)
+		{
+			mesh_handle mesh {
+				vertex_allocator.allocate(vertex_count),
+				index_count > 0 ? index_allocator.allocate(index_count) : allocation {},
+			};
+
+			if (!mesh.vertices.valid() || (index_count > 0 && !mesh.indices.valid()))
+			{
+				this->free(mesh);
+				throw std::runtime_error("mesh heap is out of memory");
+			}
+
+			vertex_buffer.write(vertices, vertex_count * vertex_stride, mesh.vertices.offset * vertex_stride);
+
+			if (index_count > 0)
+			{
+				index_buffer.write(indices, index_count * sizeof(uint32_t), mesh.indices.offset * sizeof(uint32_t));
+			}
+
+			return mesh;
+		}
+
+		void free(const mesh_handle &mesh)
+		{
+			vertex_allocator.free(mesh.vertices);
+			index_allocator.free(mesh.indices);
+		}
+
+		/**
+		 * Binds the shared element buffer to the currently bound vertex array.
+		 *
+		 * @remarks The vertex buffer has to be set up using get_vertex_buffer().bind_vertex (or an
+		 *          equivalent), as the heap does not know about the vertex format. Without direct state
+		 *          access uploads unbind the element buffer, so this should be called after the last
+		 *          allocate of the frame.
+		 */
+		void bind_indices()
+		{
+			index_buffer.bind_indices();
+		}
+
+		void draw(const mesh_handle &mesh)
+		{
+			gfx::draw_elements_base_vertex(mesh.index_count(), mesh.first_index(), mesh.base_vertex());
+		}
+
+		storage_report vertex_report() const
+		{
+			return vertex_allocator.report();
+		}
+
+		storage_report index_report() const
+		{
+			return index_allocator.report();
+		}
+
+		buffer &get_vertex_buffer()
+		{
+			return vertex_buffer;
+		}
+
+		buffer &get_index_buffer()
+		{
+			return index_buffer;
+		}
+
+	private:
+		int vertex_stride;
+
+		offset_allocator vertex_allocator;
+		offset_allocator index_allocator;
+
+		buffer vertex_buffer;
+		buffer index_buffer;
+	};
+}
@@ -0,0 +1,312 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <hash.hpp>
+#include <memory>
+#include <optional>
+#include <shader.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * Expands GLSL sources before they are handed to the compiler.
+	 *
+	 * @remarks "#include "file"" directives are replaced by the contents of the file, looked up relative
+	 *          to the including file first and then in every include directory. Every file is included
+	 *          at most once per expansion, so include guards are not needed. Defines are injected right
+	 *          after the "#version" line. Both file contents and expanded sources are cached, call
+	 *          invalidate after files have changed on disk.
+	 */
+	class preprocessor
+	{
+	public:
+		void add_include_directory(std::filesystem::path directory)
+		{
+			include_directories.push_back(std::move(directory));
+		}
+
+		/**
+		 * Expands a shader file.
+		 *
+		 * @param file     The path of the shader file.
+		 * @param defines  The defines to inject, either "NAME" or "NAME VALUE".
+		 *
+		 * @return The expanded source, which stays cached until invalidate is called.
+		 */
+		const std::string &expand(const std::filesystem::path &file, const std::vector<std::string> &defines = {})
+		{
+			uint64_t key = hash::fnv1a(file.string());
+
+			for (const std::string &define : defines)
+			{
+				key = hash::combine(key, hash::fnv1a(define));
+			}
+
+			auto it = expanded.find(key);
+			if (it != expanded.end())
+			{
+				return it->second;
+			}
+
+			std::unordered_set<std::string> included;
+			std::string source = resolve(file, included);
+
+			return expanded.emplace(key, inject(source, defines)).first->second;
+		}
+
+		/**
+		 * Forgets every cached file and expansion, so the next expand reads from disk again.
+		 */
+		void invalidate()
+		{
+			files.clear();
+			expanded.clear();
+		}
+
+		/**
+		 * Forgets a single file, so the next expand that needs it reads it from disk again. Every other
+		 * file stays cached, expansions are only assembled again from the cached files.
+		 */
+		void invalidate(const std::filesystem::path &file)
+		{
+			files.erase(file.string());
+			expanded.clear();
+		}
+
+	private:
+		std::vector<std::filesystem::path> include_directories;
+		std::unordered_map<std::string, std::string> files;
+		std::unordered_map<uint64_t, std::string> expanded;
+
+		const std::string &read(const std::filesystem::path &file)
+		{
+			auto it = files.find(file.string());
+			if (it != files.end())
+			{
+				return it->second;
+			}
+
+			auto code = shader::read_file(file.string().c_str());
+			if (!code.has_value())
+			{
+				throw std::runtime_error(std::format("unable to read shader file {}", file.string()));
+			}
+
+			return files.emplace(file.string(), std::move(*code)).first->second;
+		}
+
+		std::filesystem::path locate(const std::filesystem::path &from, const std::string &name)
+		{
+			std::filesystem::path relative = from.parent_path() / name;
+			if (std::filesystem::exists(relative))
+			{
+				return relative.lexically_normal();
+			}
+
+			for (const std::filesystem::path &directory : include_directories)
+			{
+				std::filesystem::path candidate = directory / name;
+				if (std::filesystem::exists(candidate))
+				{
+					return candidate.lexically_normal();
+				}
+			}
+
+			throw std::runtime_error(std::format("unable to find include {} from {}", name, from.string()));
+		}
+
+		std::string resolve(const std::filesystem::path &file, std::unordered_set<std::string> &included)
+		{
+			included.insert(file.lexically_normal().string());
+
+			std::istringstream stream(read(file));
+			std::string output;
+			std::string line;
+			int line_number = 0;
+
+			while (std::getline(stream, line))
+			{
+				line_number++;
+
+				std::string_view directive = line;
+				directive.remove_prefix(std::min(directive.find_first_not_of(" \t"), directive.size()));
+
+				if (!directive.starts_with("#include"))
+				{
+					output += line;
+					output += '\n';
+					continue;
+				}
+
+				size_t begin = directive.find_first_of("\"<");
+				size_t end = directive.find_last_of("\">");
+
+				if (begin == std::string_view::npos || end == std::string_view::npos || end <= begin)
+				{
+					throw std::runtime_error(std::format("malformed include in {}:{}", file.string(), line_number));
+				}
+
+				std::filesystem::path target = locate(file, std::string(directive.substr(begin + 1, end - begin - 1)));
+
+				if (included.contains(target.string()))
+				{
+					output += '\n';
+					continue;
+				}
+
+				output += "#line 1\n";
+				output += resolve(target, included);
+				output += std::format("#line {}\n", line_number + 1);
+			}
+
+			return output;
+		}
+
+		static std::string inject(const std::string &source, const std::vector<std::string> &defines)
+		{
+			if (defines.empty())
+			{
+				return source;
+			}
+
+			std::string block;
+			for (const std::string &define : defines)
+			{
+				block += std::format("#define {}\n", define);
+			}
+
+			size_t version = source.find("#version");
+			if (version == std::string::npos)
+			{
+				return block + "#line 1\n" + source;
+			}
+
+			size_t line_end = source.find('\n', version);
+			if (line_end == std::string::npos)
+			{
+				return source + "\n" + block;
+			}
+
+			// #line keeps the compiler's line numbers in sync with the original file, where #version
+			// may follow comments or blank lines
+			auto version_line = std::count(source.begin(), source.begin() + version, '\n') + 1;
+			return source.substr(0, line_end + 1) + block + std::format("#line {}\n", version_line + 1) + source.substr(line_end + 1);
+		}
+	};
+
+	struct stage_file {
+		shader_type type;
+		std::filesystem::path path;
+	};
+
+	/**
+	 * Every permutation of a program over a set of keywords.
+	 *
+	 * @remarks Keyword "i" corresponds to bit "i" of a variant mask and is injected as a define when that
+	 *          bit is set. Variants are compiled the first time they are requested, after which getting
+	 *          one is an array index and a null check.
+	 */
+	class variant_set
+	{
+	public:
+		/**
+		 * @param preprocessor  The preprocessor used to expand the stages. It must outlive the set.
+		 * @param keywords      The keywords, at most 16.
+		 * @param stages        The shader files making up the program.
+		 * @param cache         An optional program cache, used for every variant.
+		 */
+		variant_set(preprocessor &preprocessor, std::vector<std::string> keywords, std::vector<stage_file> stages, program_cache *cache = nullptr)
+			: pre { preprocessor }
+			, keywords { std::move(keywords) }
+			, stages { std::move(stages) }
+			, cache { cache }
+		{
+			if (this->keywords.size() > 16)
+			{
+				throw std::runtime_error("a variant set supports at most 16 keywords");
+			}
+
+			variants.resize(size_t { 1 } << this->keywords.size());
+		}
+
+		/**
+		 * Returns the mask bit of a keyword. This is a linear search, so the result should be kept around.
+		 */
+		uint32_t keyword(std::string_view name) const
+		{
+			for (size_t i = 0; i < keywords.size(); i++)
+			{
+				if (keywords[i] == name)
+				{
+					return 1u << i;
+				}
+			}
+
+			throw std::runtime_error(std::format("unknown shader keyword {}", name));
+		}
+
+		/**
+		 * Returns the variant for a keyword mask, compiling it first if this is the first request.
+		 */
+		shader &get(uint32_t mask)
+		{
+			std::unique_ptr<shader> &variant = variants[mask];
+
+			if (variant == nullptr) [[unlikely]]
+			{
+				variant = std::make_unique<shader>(compile(mask));
+			}
+
+			return *variant;
+		}
+
+		/**
+		 * Compiles every variant that has not been requested yet, e.g. on a loading screen.
+		 */
+		void warm_up()
+		{
+			for (uint32_t mask = 0; mask < variants.size(); mask++)
+			{
+				this->get(mask);
+			}
+		}
+
+	private:
+		preprocessor &pre;
+		std::vector<std::string> keywords;
+		std::vector<stage_file> stages;
+		program_cache *cache;
+
+		std::vector<std::unique_ptr<shader>> variants;
+
+		shader compile(uint32_t mask)
+		{
+			std::vector<std::string> defines;
+
+			for (size_t i = 0; i < keywords.size(); i++)
+			{
+				if (mask & (1u << i))
+				{
+					defines.push_back(keywords[i]);
+				}
+			}
+
+			std::vector<stage_source> sources;
+
+			for (const stage_file &stage : stages)
+			{
+				sources.push_back({ stage.type, pre.expand(stage.path, defines) });
+			}
+
+			return cache != nullptr ? shader(sources, *cache) : shader(sources);
+		}
+	};
+}
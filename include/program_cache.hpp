@@ -0,0 +1,171 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <hash.hpp>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * Returns a hash of the GL vendor, renderer and version strings, for anything stored on disk that
+	 * is only valid for the driver that produced it.
+	 */
+	inline uint64_t device_hash()
+	{
+		uint64_t device = hash::fnv_offset;
+
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			auto value = reinterpret_cast<const char *>(glGetString(name));
+			device = hash::fnv1a(value != nullptr ? value : "", device);
+		}
+
+		return device;
+	}
+
+	struct cache_stats {
+		int hits = 0;
+		int misses = 0;
+		int rejected = 0;
+	};
+
+	/**
+	 * Stores linked program binaries on disk, so later launches can skip compiling and linking.
+	 *
+	 * @remarks Binaries are keyed by a hash of the (fully expanded) sources combined with the GL vendor,
+	 *          renderer and version strings, as drivers only accept binaries they produced themselves.
+	 *          A binary the driver rejects anyway (e.g. after a driver update with the same version
+	 *          string) counts as a miss and is replaced once the program has been compiled normally.
+	 */
+	class program_cache
+	{
+	public:
+		/**
+		 * @param directory  The directory the binaries are stored in. It is created if it does not exist.
+		 */
+		program_cache(std::filesystem::path directory)
+			: directory { std::move(directory) }
+		{
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+			supported = formats > 0;
+
+			device_hash = ::shader::device_hash();
+
+			std::error_code error;
+			std::filesystem::create_directories(this->directory, error);
+		}
+
+		/**
+		 * Combines a hash of the program's sources with the driver identity into a cache key.
+		 */
+		uint64_t key(uint64_t source_hash) const
+		{
+			return hash::combine(device_hash, source_hash);
+		}
+
+		/**
+		 * Tries to load a cached binary into a program.
+		 *
+		 * @param program  A program without any attached shaders.
+		 * @param key      The key returned by key.
+		 *
+		 * @return Whether the program was loaded and linked successfully. If not, the program has to be
+		 *         compiled and linked normally, after which store should be called.
+		 */
+		bool load(GLuint program, uint64_t key)
+		{
+			std::ifstream stream(path(key), std::ios::binary);
+
+			if (!supported || !stream.is_open())
+			{
+				stats.misses++;
+				return false;
+			}
+
+			GLenum format = 0;
+			stream.read(reinterpret_cast<char *>(&format), sizeof(format));
+
+			std::vector<char> binary((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+			glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+			GLint status = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+			if (status != GL_TRUE)
+			{
+				stats.misses++;
+				stats.rejected++;
+				return false;
+			}
+
+			stats.hits++;
+			return true;
+		}
+
+		/**
+		 * Writes the binary of a linked program to the cache.
+		 *
+		 * @remarks The program should have GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before it was linked.
+		 */
+		void store(GLuint program, uint64_t key)
+		{
+			if (!supported)
+			{
+				return;
+			}
+
+			GLint length = 0;
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+
+			if (length <= 0)
+			{
+				return;
+			}
+
+			GLenum format = 0;
+			std::vector<char> binary(length);
+			glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+			std::ofstream stream(path(key), std::ios::binary | std::ios::trunc);
+			stream.write(reinterpret_cast<const char *>(&format), sizeof(format));
+			stream.write(binary.data(), length);
+		}
+
+		/**
+		 * Logs the number of cache hits and misses so far, e.g. once all programs have been loaded.
+		 */
+		void report() const
+		{
+			spdlog::info("program cache: {} hits, {} misses ({} rejected by the driver)", stats.hits, stats.misses, stats.rejected);
+		}
+
+		cache_stats get_stats() const
+		{
+			return stats;
+		}
+
+		bool is_supported() const
+		{
+			return supported;
+		}
+
+	private:
+		std::filesystem::path directory;
+		uint64_t device_hash = hash::fnv_offset;
+		bool supported = false;
+		cache_stats stats;
+
+		std::filesystem::path path(uint64_t key) const
+		{
+			return directory / std::format("{:016x}.bin", key);
+		}
+	};
+}
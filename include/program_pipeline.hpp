@@ -0,0 +1,197 @@
+#pragma once
+#include <GL/glew.h>
+#include <buffer.hpp>
+#include <cstdint>
+#include <format>
+#include <shader.hpp>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * Returns the pipeline stage bit of a shader type, as used by glUseProgramStages.
+	 */
+	inline GLbitfield stage_bit(shader_type type)
+	{
+		switch (type)
+		{
+		case shader_type::Vertex:
+			return GL_VERTEX_SHADER_BIT;
+		case shader_type::Fragment:
+			return GL_FRAGMENT_SHADER_BIT;
+		case shader_type::Compute:
+			return GL_COMPUTE_SHADER_BIT;
+		}
+
+		return 0;
+	}
+
+	/**
+	 * Combines separable programs (see shader::separable) into a complete pipeline.
+	 *
+	 * @remarks Every stage is compiled and linked once on its own, and a pipeline only references the
+	 *          programs, so N vertex and M fragment variants take N + M links instead of N * M.
+	 *          Uniforms are still set on the individual programs.
+	 */
+	class program_pipeline
+	{
+	public:
+		program_pipeline()
+		{
+			if (buffer::direct_state_access())
+			{
+				glCreateProgramPipelines(1, &pipeline_id);
+			}
+			else
+			{
+				glGenProgramPipelines(1, &pipeline_id);
+			}
+		}
+
+		program_pipeline(const program_pipeline &) = delete;
+		program_pipeline &operator=(const program_pipeline &) = delete;
+
+		program_pipeline(program_pipeline &&other) noexcept
+			: pipeline_id { std::exchange(other.pipeline_id, 0) }
+		{
+		}
+
+		program_pipeline &operator=(program_pipeline &&other) noexcept
+		{
+			if (this != &other)
+			{
+				glDeleteProgramPipelines(1, &pipeline_id);
+				pipeline_id = std::exchange(other.pipeline_id, 0);
+			}
+
+			return *this;
+		}
+
+		~program_pipeline()
+		{
+			glDeleteProgramPipelines(1, &pipeline_id);
+		}
+
+		/**
+		 * Uses a separable program for a stage of the pipeline.
+		 *
+		 * @param type     The stage the program provides.
+		 * @param program  A separable program containing that stage. It must outlive its use here.
+		 */
+		program_pipeline &stage(shader_type type, shader &program)
+		{
+			glUseProgramStages(pipeline_id, stage_bit(type), program.get_id());
+			return *this;
+		}
+
+		/**
+		 * Throws if the stages of the pipeline do not fit together, e.g. mismatched interfaces.
+		 */
+		void validate()
+		{
+			glValidateProgramPipeline(pipeline_id);
+
+			GLint status = GL_FALSE;
+			glGetProgramPipelineiv(pipeline_id, GL_VALIDATE_STATUS, &status);
+
+			if (status == GL_TRUE)
+			{
+				return;
+			}
+
+			GLint log_length = 0;
+			glGetProgramPipelineiv(pipeline_id, GL_INFO_LOG_LENGTH, &log_length);
+
+			std::vector<char> error_msg(log_length + 1);
+			glGetProgramPipelineInfoLog(pipeline_id, log_length, nullptr, error_msg.data());
+
+			throw std::runtime_error(std::format("program pipeline validation error {}", error_msg.data()));
+		}
+
+		/**
+		 * Binds the pipeline. Any program bound with glUseProgram takes precedence, so that is unbound.
+		 */
+		void bind()
+		{
+			glUseProgram(0);
+			glBindProgramPipeline(pipeline_id);
+		}
+
+		GLuint get_id() const
+		{
+			return pipeline_id;
+		}
+
+	private:
+		GLuint pipeline_id = 0;
+	};
+
+	/**
+	 * Creates one pipeline per combination of vertex and fragment program the first time it is used.
+	 *
+	 * @remarks Pipelines are keyed by program names, which GL reuses once a program is deleted. Every
+	 *          entry also remembers the serials of its programs, so a pipeline whose program was
+	 *          destroyed or reloaded in the meantime is staged again instead of drawing with the old
+	 *          program. evict frees the pipelines of a program that is gone, e.g. from the reload
+	 *          callback of a shader_watcher.
+	 */
+	class pipeline_cache
+	{
+	public:
+		/**
+		 * Returns the pipeline made of a vertex and a fragment program, creating it if needed.
+		 */
+		program_pipeline &get(shader &vertex, shader &fragment)
+		{
+			// two 32 bit names fit into the key exactly, so different pairs never collide
+			uint64_t key = (static_cast<uint64_t>(vertex.get_id()) << 32) | fragment.get_id();
+			entry &cached = pipelines[key];
+
+			if (cached.vertex_serial != vertex.get_serial() || cached.fragment_serial != fragment.get_serial())
+			{
+				cached.pipeline.stage(shader_type::Vertex, vertex).stage(shader_type::Fragment, fragment);
+				cached.vertex_serial = vertex.get_serial();
+				cached.fragment_serial = fragment.get_serial();
+			}
+
+			return cached.pipeline;
+		}
+
+		/**
+		 * Forgets every pipeline using a program.
+		 *
+		 * @param program  The ID of the program, e.g. its ID before it was reloaded.
+		 */
+		void evict(GLuint program)
+		{
+			std::erase_if(pipelines, [&](const auto &entry) {
+				return static_cast<GLuint>(entry.first >> 32) == program || static_cast<GLuint>(entry.first) == program;
+			});
+		}
+
+		/**
+		 * Forgets every pipeline, e.g. after programs have been destroyed or reloaded.
+		 */
+		void clear()
+		{
+			pipelines.clear();
+		}
+
+		size_t size() const
+		{
+			return pipelines.size();
+		}
+
+	private:
+		struct entry {
+			program_pipeline pipeline;
+			uint64_t vertex_serial = 0;
+			uint64_t fragment_serial = 0;
+		};
+
+		std::unordered_map<uint64_t, entry> pipelines;
+	};
+}
@@ -0,0 +1,230 @@
+#pragma once
+#include <GL/glew.h>
+#include <buffer.hpp>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+namespace buffer
+{
+	/**
+	 * Reads buffer contents back to the CPU without stalling the pipeline.
+	 *
+	 * @remarks A read copies the requested range into a staging buffer on the GPU and places a fence
+	 *          right after the copy. poll (called once per frame) checks the fences without waiting,
+	 *          and only maps a staging buffer once its copy has finished, which is usually a frame or
+	 *          two later. Staging buffers are kept around and reused by later reads.
+	 *
+	 *          This is a queue next to buffer rather than a buffer method, so one poll per frame
+	 *          completes the reads of every buffer and the staging buffers are shared between them. If a
+	 *          staging buffer cannot be mapped, the read is dropped and its callback is never called
+	 *          (the future of a read then reports a broken promise).
+	 */
+	class readback_queue
+	{
+	public:
+		using callback = std::function<void(const std::vector<char> &)>;
+
+		readback_queue() = default;
+		readback_queue(const readback_queue &) = delete;
+		readback_queue &operator=(const readback_queue &) = delete;
+
+		~readback_queue()
+		{
+			for (request &pending : requests)
+			{
+				glDeleteSync(pending.fence);
+				glDeleteBuffers(1, &pending.staging.id);
+			}
+
+			for (staging_buffer &free : pool)
+			{
+				glDeleteBuffers(1, &free.id);
+			}
+		}
+
+		/**
+		 * Starts reading a range of a buffer back to the CPU.
+		 *
+		 * @param source     The buffer to read from, e.g. a shader storage buffer written by a compute shader.
+		 * @param offset     The offset (in bytes) to read from.
+		 * @param size       The size (in bytes) to read.
+		 * @param on_ready   Called from poll with the data once it has arrived.
+		 */
+		void read(buffer &source, int offset, int size, callback on_ready)
+		{
+			staging_buffer target = acquire(size);
+
+			// make shader writes to the source visible to the copy below
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			source.copy_to(target.id, offset, 0, size);
+
+			requests.push_back({
+				target,
+				size,
+				glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0),
+				std::move(on_ready),
+			});
+		}
+
+		/**
+		 * Starts reading a range of a buffer back to the CPU.
+		 *
+		 * @return A future which becomes ready in the poll call that sees the copy has finished. Waiting
+		 *         on it without calling poll will never complete.
+		 */
+		std::future<std::vector<char>> read(buffer &source, int offset, int size)
+		{
+			auto promise = std::make_shared<std::promise<std::vector<char>>>();
+			auto future = promise->get_future();
+
+			this->read(source, offset, size, [promise](const std::vector<char> &data) {
+				promise->set_value(data);
+			});
+
+			return future;
+		}
+
+		/**
+		 * Completes every read whose copy has finished on the GPU. This never blocks.
+		 */
+		void poll()
+		{
+			std::vector<request> completed;
+			size_t kept = 0;
+
+			for (size_t i = 0; i < requests.size(); i++)
+			{
+				request &pending = requests[i];
+				GLenum status = glClientWaitSync(pending.fence, 0, 0);
+
+				if (status == GL_TIMEOUT_EXPIRED)
+				{
+					// flush once so the fence is guaranteed to signal eventually
+					if (!pending.flushed)
+					{
+						glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+						pending.flushed = true;
+					}
+
+					if (kept != i)
+					{
+						requests[kept] = std::move(pending);
+					}
+
+					kept++;
+					continue;
+				}
+
+				completed.push_back(std::move(pending));
+			}
+
+			requests.resize(kept);
+
+			// callbacks run last, as they are free to start new reads
+			for (request &done : completed)
+			{
+				glDeleteSync(done.fence);
+
+				std::vector<char> data(done.size);
+
+				if (!map(done.staging.id, data.data(), done.size))
+				{
+					spdlog::error("unable to map readback staging buffer, dropping a read of {} bytes", done.size);
+					glDeleteBuffers(1, &done.staging.id);
+					continue;
+				}
+
+				pool.push_back(done.staging);
+				done.on_ready(data);
+			}
+		}
+
+		/**
+		 * Returns the number of reads that have not completed yet.
+		 */
+		size_t pending() const
+		{
+			return requests.size();
+		}
+
+	private:
+		struct staging_buffer {
+			GLuint id;
+			int size;
+		};
+
+		struct request {
+			staging_buffer staging;
+			int size;
+			GLsync fence;
+			callback on_ready;
+			bool flushed = false;
+		};
+
+		std::vector<request> requests;
+		std::vector<staging_buffer> pool;
+
+		staging_buffer acquire(int size)
+		{
+			auto best = pool.end();
+
+			for (auto it = pool.begin(); it != pool.end(); it++)
+			{
+				if (it->size >= size && (best == pool.end() || it->size < best->size))
+				{
+					best = it;
+				}
+			}
+
+			if (best != pool.end())
+			{
+				staging_buffer found = *best;
+				pool.erase(best);
+
+				return found;
+			}
+
+			staging_buffer created { 0, size };
+
+			glGenBuffers(1, &created.id);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, created.id);
+			glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+			return created;
+		}
+
+		static bool map(GLuint id, char *destination, int size)
+		{
+			if (direct_state_access())
+			{
+				void *mapped = glMapNamedBufferRange(id, 0, size, GL_MAP_READ_BIT);
+
+				if (mapped == nullptr)
+				{
+					return false;
+				}
+
+				std::memcpy(destination, mapped, size);
+				glUnmapNamedBuffer(id);
+				return true;
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, id);
+			void *mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+			if (mapped != nullptr)
+			{
+				std::memcpy(destination, mapped, size);
+				glUnmapBuffer(GL_COPY_READ_BUFFER);
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			return mapped != nullptr;
+		}
+	};
+}
@@ -31,8 +31,11 @@ namespace gfx
 	void clear_color(std::array<float, 4> color);
 	void enable_vertex(int attribute_index);
 	void vertex_attribute(int attributeIndex, int size, void *offset);
+	void vertex_attribute(int attributeIndex, int size, int type, bool normalized, int stride, void *offset);
 	void index_buffer();
 	void draw_elements(int indices);
+	void draw_elements_base_vertex(int indices, int first_index, int base_vertex);
+	void multi_draw_elements_indirect(int draw_count);
 	void draw_arrays(int attributeIndex, int count);
 }
 
@@ -1,13 +1,28 @@
 #pragma once
 #include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <barrier.hpp>
+#include <block_layout.hpp>
+#include <buffer.hpp>
+#include <embedded_source.hpp>
 #include <format>
 #include <fstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
-#include <map>
+#include <optional>
+#include <program_cache.hpp>
+#include <span>
 #include <sstream>
+#include <stage_cache.hpp>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <uniform_table.hpp>
+#include <uniform_traits.hpp>
+#include <utility>
 #include <vector>
 
 namespace shader
@@ -19,6 +34,25 @@ namespace shader
 		Compute = GL_COMPUTE_SHADER
 	};
 
+	struct stage_source {
+		shader_type type;
+		std::string code;
+	};
+
+	struct embedded_stage {
+		shader_type type;
+		const embedded_source &source;
+	};
+
+	/**
+	 * The layout glDispatchComputeIndirect expects in the dispatch indirect buffer.
+	 */
+	struct dispatch_indirect_command {
+		GLuint groups_x;
+		GLuint groups_y;
+		GLuint groups_z;
+	};
+
 	class shader
 	{
 	public:
@@ -39,22 +73,249 @@ namespace shader
 			this->link();
 		}
 
-		GLuint get_uniform_location(const char *name)
+		shader(const char *vertex_file_path, const char *fragment_file_path, program_cache &cache)
+		{
+			id = glCreateProgram();
+
+			this->build({ read_stage(vertex_file_path, shader_type::Vertex), read_stage(fragment_file_path, shader_type::Fragment) }, cache);
+		}
+
+		shader(const char *compute_file_path, program_cache &cache)
+		{
+			id = glCreateProgram();
+
+			this->build({ read_stage(compute_file_path, shader_type::Compute) }, cache);
+		}
+
+		/**
+		 * Creates a program from sources that are already in memory, e.g. expanded by a preprocessor.
+		 */
+		shader(const std::vector<stage_source> &stages)
+		{
+			id = glCreateProgram();
+
+			for (const stage_source &stage : stages)
+			{
+				this->compile_source(stage.code, stage.type);
+			}
+
+			this->link();
+		}
+
+		shader(const std::vector<stage_source> &stages, program_cache &cache)
+		{
+			id = glCreateProgram();
+
+			this->build(stages, cache);
+		}
+
+		/**
+		 * Creates a program from sources embedded at build time, without reading any file.
+		 */
+		shader(std::initializer_list<embedded_stage> stages)
+		{
+			id = glCreateProgram();
+
+			for (const embedded_stage &stage : stages)
+			{
+				this->compile_source(stage.source.code, stage.type);
+			}
+
+			this->link();
+		}
+
+		/**
+		 * Creates a program from embedded sources, keyed in the cache by their precomputed hashes.
+		 */
+		shader(std::initializer_list<embedded_stage> stages, program_cache &cache)
+		{
+			id = glCreateProgram();
+
+			uint64_t source_hash = hash::fnv_offset;
+
+			for (const embedded_stage &stage : stages)
+			{
+				source_hash = hash::combine(source_hash, static_cast<uint64_t>(stage.type));
+				source_hash = hash::combine(source_hash, stage.source.hash);
+			}
+
+			this->build(cache.key(source_hash), cache, [&]() {
+				for (const embedded_stage &stage : stages)
+				{
+					this->compile_source(stage.source.code, stage.type);
+				}
+			});
+		}
+
+		shader(const shader &) = delete;
+		shader &operator=(const shader &) = delete;
+
+		shader(shader &&other) noexcept
+			: id { std::exchange(other.id, 0) }
+			, uniforms { std::move(other.uniforms) }
+			, local_size { other.local_size }
+			, stage_ids { std::exchange(other.stage_ids, {}) }
+			, serial { other.serial }
+		{
+		}
+
+		shader &operator=(shader &&other) noexcept
 		{
-			if (this->uniform_map.contains(name))
+			if (this != &other)
 			{
-				return uniform_map[name];
+				this->release_stages();
+				glDeleteProgram(id);
+
+				id = std::exchange(other.id, 0);
+				uniforms = std::move(other.uniforms);
+				local_size = other.local_size;
+				stage_ids = std::exchange(other.stage_ids, {});
+				serial = other.serial;
 			}
 
-			return glGetUniformLocation(id, name);
+			return *this;
+		}
+
+		/**
+		 * Takes ownership of a program that has already been linked, e.g. by an async_compiler.
+		 *
+		 * @param program  The ID of the linked program.
+		 */
+		static shader adopt(GLuint program)
+		{
+			return shader(adopt_tag {}, program);
+		}
+
+		/**
+		 * Creates a separable program made of a single stage, to be combined with other stages in a
+		 * program_pipeline without linking them together.
+		 *
+		 * @remarks This requires OpenGL 4.1 or ARB_separate_shader_objects. A separable vertex stage
+		 *          has to redeclare the gl_PerVertex block it writes to.
+		 */
+		static shader separable(const stage_source &stage)
+		{
+			return shader(separable_tag {}, stage, nullptr);
+		}
+
+		static shader separable(const stage_source &stage, program_cache &cache)
+		{
+			return shader(separable_tag {}, stage, &cache);
 		}
 
-		void bind_mat4(const char *name, const glm::mat4 &matrix, bool transpose)
+		/**
+		 * Reads a shader source file, or returns nothing (after logging) if it cannot be opened.
+		 */
+		static std::optional<std::string> read_file(const char *file_path)
 		{
-			auto location = get_uniform_location(name);
-			auto ptr = glm::value_ptr(matrix);
+			std::ifstream stream(file_path, std::ios::in);
+			if (!stream.is_open())
+			{
+				std::cout << "Failed to open shader file: " << file_path << std::endl;
+				return std::nullopt;
+			}
 
-			glUniformMatrix4fv(location, 1, transpose, ptr);
+			std::stringstream sstr;
+			sstr << stream.rdbuf();
+
+			return sstr.str();
+		}
+
+		/**
+		 * Throws if a shader object failed to compile, with the compiler's log as the message.
+		 */
+		static void check_compile(GLuint shader_id)
+		{
+			GLint result = GL_FALSE;
+			int info_length;
+
+			// Check for compilation errors
+			glGetShaderiv(shader_id, GL_COMPILE_STATUS, &result);
+			glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &info_length);
+			if (info_length > 0)
+			{
+				std::vector<char> error_msg(info_length + 1);
+				glGetShaderInfoLog(shader_id, info_length, NULL, &error_msg[0]);
+				throw std::runtime_error(
+					std::format("shader compilation error {}", &error_msg[0]) // ugly, but deal with it.
+				);
+			}
+		}
+
+		/**
+		 * Throws if a program failed to link.
+		 */
+		static void check_link(GLuint program)
+		{
+			GLint result = GL_FALSE;
+			int log_length;
+
+			// Check the program
+			glGetProgramiv(program, GL_LINK_STATUS, &result);
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &log_length);
+			if (log_length > 0)
+			{
+				std::vector<char> error_msg(log_length + 1);
+				glGetProgramInfoLog(program, log_length, NULL, &error_msg[0]);
+
+				throw std::runtime_error("program linking error");
+			}
+		}
+
+		/**
+		 * Returns a hash of the given stages, covering both their types and sources.
+		 */
+		static uint64_t hash_sources(const std::vector<stage_source> &stages)
+		{
+			uint64_t value = hash::fnv_offset;
+
+			for (const stage_source &stage : stages)
+			{
+				value = hash::combine(value, static_cast<uint64_t>(stage.type));
+				value = hash::combine(value, hash::fnv1a(stage.code));
+			}
+
+			return value;
+		}
+
+		/**
+		 * Returns the location of a uniform, or -1 if the program has no active uniform with that name.
+		 * This is a table lookup, it never queries GL.
+		 */
+		GLint get_uniform_location(uniform_key name)
+		{
+			return uniforms.location(name);
+		}
+
+		const uniform_table &get_uniforms()
+		{
+			return uniforms;
+		}
+
+		/**
+		 * Resolves a uniform once, so later writes through the handle skip the name lookup.
+		 */
+		uniform_handle uniform(uniform_key name)
+		{
+			uniform_handle handle { name };
+			uniforms.resolve(handle);
+
+			return handle;
+		}
+
+		void bind_mat4(uniform_key name, const glm::mat4 &matrix, bool transpose)
+		{
+			uniform_info *info = uniforms.find(name);
+
+			// the shadow holds the value GL ends up with, so a transposed write is compared transposed
+			glm::mat4 value = transpose ? glm::transpose(matrix) : matrix;
+
+			if (info == nullptr || !uniforms.update(*info, &value, sizeof(value)))
+			{
+				return;
+			}
+
+			glProgramUniformMatrix4fv(id, info->location, 1, GL_FALSE, glm::value_ptr(value));
 		}
 
 		void bind()
@@ -62,8 +323,23 @@ namespace shader
 			glUseProgram(id);
 		}
 
+		GLuint get_id() const
+		{
+			return id;
+		}
+
+		/**
+		 * Returns a number identifying the linked program for the lifetime of the process. Unlike the
+		 * ID, it is never reused by a later program, e.g. after a reload.
+		 */
+		uint64_t get_serial() const
+		{
+			return serial;
+		}
+
 		~shader()
 		{
+			this->release_stages();
 			glDeleteProgram(id);
 		}
 
@@ -74,6 +350,103 @@ namespace shader
 			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 		}
 
+		/**
+		 * Dispatches the program, issuing a memory barrier only if it reads the result of an earlier
+		 * shader write, and recording its own writes for later commands.
+		 *
+		 * @param resources  Every buffer and texture the dispatch reads or writes, e.g.
+		 *                   { gfx::reads(particles, gfx::access::storage), gfx::writes(positions) }.
+		 *
+		 * @remarks Unlike the overload above, no barrier is issued after the dispatch. Draws that consume
+		 *          its output have to call gfx::barrier_tracker::get().prepare with their own reads.
+		 */
+		void dispatch_compute(int groups_x, int groups_y, int groups_z, std::initializer_list<gfx::resource_use> resources)
+		{
+			gfx::barrier_tracker &tracker = gfx::barrier_tracker::get();
+
+			tracker.prepare(resources);
+
+			this->bind();
+			glDispatchCompute(groups_x, groups_y, groups_z);
+
+			tracker.commit(resources);
+		}
+
+		/**
+		 * Returns the local size of a compute program, as declared by its layout qualifier.
+		 */
+		glm::ivec3 get_local_size()
+		{
+			if (local_size.x == 0)
+			{
+				glGetProgramiv(id, GL_COMPUTE_WORK_GROUP_SIZE, glm::value_ptr(local_size));
+			}
+
+			return local_size;
+		}
+
+		/**
+		 * Dispatches enough groups to cover the given number of invocations, whatever the program's
+		 * local size is, e.g. one chosen by a workgroup_tuner.
+		 *
+		 * @remarks The last group in each dimension may be partially outside the range, so the shader
+		 *          has to check gl_GlobalInvocationID against the size it was dispatched for. Like
+		 *          dispatch_compute without resources, this always issues a storage barrier afterwards.
+		 */
+		void dispatch_threads(int threads_x, int threads_y, int threads_z)
+		{
+			glm::ivec3 groups = this->group_count(threads_x, threads_y, threads_z);
+
+			this->dispatch_compute(groups.x, groups.y, groups.z);
+		}
+
+		/**
+		 * Dispatches enough groups to cover the given number of invocations, issuing barriers through
+		 * the barrier_tracker like the tracked dispatch_compute overload.
+		 */
+		void dispatch_threads(int threads_x, int threads_y, int threads_z, std::initializer_list<gfx::resource_use> resources)
+		{
+			glm::ivec3 groups = this->group_count(threads_x, threads_y, threads_z);
+
+			this->dispatch_compute(groups.x, groups.y, groups.z, resources);
+		}
+
+		/**
+		 * Dispatches the program with group counts read from a buffer on the GPU, e.g. written by an
+		 * earlier dispatch that culled instances or spawned particles.
+		 *
+		 * @param arguments  The buffer holding a dispatch_indirect_command.
+		 * @param offset     The offset (in bytes) of the command in the buffer, a multiple of 4.
+		 * @param resources  Every other buffer and texture the dispatch reads or writes.
+		 *
+		 * @remarks The arguments are tracked like any other resource, so if they were written by a
+		 *          shader, a command barrier is issued before this dispatch and nothing is read back
+		 *          to the CPU.
+		 */
+		void dispatch_compute_indirect(buffer::buffer &arguments, int offset = 0, std::initializer_list<gfx::resource_use> resources = {})
+		{
+			if (offset < 0 || offset % 4 != 0 || offset + static_cast<int>(sizeof(dispatch_indirect_command)) > arguments.get_size())
+			{
+				throw std::out_of_range("invalid dispatch indirect offset");
+			}
+
+			gfx::barrier_tracker &tracker = gfx::barrier_tracker::get();
+
+			for (const gfx::resource_use &use : resources)
+			{
+				tracker.require(use);
+			}
+
+			tracker.require(gfx::reads(arguments, gfx::access::indirect));
+			tracker.flush();
+
+			this->bind();
+			arguments.bind_dispatch_indirect();
+			glDispatchComputeIndirect(offset);
+
+			tracker.commit(resources);
+		}
+
 		void set_uniform_buffer(const std::string &name, GLuint bufferBinding)
 		{
 			GLuint blockIndex = glGetUniformBlockIndex(id, name.c_str());
@@ -81,95 +454,255 @@ namespace shader
 			glBindBufferBase(GL_UNIFORM_BUFFER, bufferBinding, bufferBinding);
 		}
 
+		/**
+		 * Throws if a uniform or shader storage block of this program does not match the C++ struct
+		 * that mirrors it, see block_layout.hpp.
+		 */
 		template<typename T>
-		void set_uniform(const std::string &name, const T &value)
+		void validate_block(const std::string &name, std::span<const block_member> members)
 		{
-			GLuint program = id;
-			GLint location = glGetUniformLocation(program, name.c_str());
+			::shader::validate_block<T>(id, name, members);
+		}
 
-			if (location != -1)
-			{
-				if constexpr (std::is_same_v<T, int>)
-				{
-					glProgramUniform1i(program, location, value);
-				}
-				else if constexpr (std::is_same_v<T, float>)
-				{
-					glProgramUniform1f(program, location, value);
-				}
-				else if constexpr (std::is_same_v<T, glm::vec3>)
-				{
-					glProgramUniform3fv(program, location, 1, glm::value_ptr(value));
-				}
-			}
+		/**
+		 * Writes a uniform of any type that has a uniform_traits specialization.
+		 *
+		 * @remarks The program does not have to be bound, every write goes through glProgramUniform*.
+		 *          Writes of a value the program already holds are skipped.
+		 */
+		template<typename T>
+		void set_uniform(uniform_key name, const T &value)
+		{
+			this->upload(uniforms.find(name), &value, 1);
+		}
+
+		template<typename T>
+		void set_uniform(uniform_handle &handle, const T &value)
+		{
+			this->upload(uniforms.resolve(handle), &value, 1);
+		}
+
+		/**
+		 * Writes consecutive elements of a uniform array in a single call, e.g. the bone matrices of
+		 * a skinned mesh.
+		 *
+		 * @param name    The array, or the first element to write, e.g. "bones" or "bones[4]".
+		 * @param values  The elements to write.
+		 */
+		template<typename T, size_t N>
+		void set_uniform(uniform_key name, std::span<T, N> values)
+		{
+			this->upload(uniforms.find(name), values.data(), values.size());
+		}
+
+		template<typename T, size_t N>
+		void set_uniform(uniform_handle &handle, std::span<T, N> values)
+		{
+			this->upload(uniforms.resolve(handle), values.data(), values.size());
 		}
 
 	private:
+		struct adopt_tag {
+		};
+
+		struct separable_tag {
+		};
+
 		GLuint id;
-		std::map<const char *, GLuint> uniform_map;
+		uniform_table uniforms;
+		glm::ivec3 local_size { 0 };
 
-		void compile(const char *file_path, shader_type type)
+		// the keys and IDs of the cached stage objects this program was linked from, see stage_cache
+		std::vector<std::pair<uint64_t, GLuint>> stage_ids;
+
+		uint64_t serial = next_serial();
+
+		shader(adopt_tag, GLuint program)
+			: id { program }
 		{
-			GLuint shader_id = glCreateShader(static_cast<int>(type));
+			uniforms.reflect(id);
+		}
 
-			// Read the shader code from the file
-			std::string code;
-			std::ifstream stream(file_path, std::ios::in);
-			if (stream.is_open())
+		shader(separable_tag, const stage_source &stage, program_cache *cache)
+		{
+			if (!GLEW_ARB_separate_shader_objects)
 			{
-				std::stringstream sstr;
-				sstr << stream.rdbuf();
-				code = sstr.str();
-				stream.close();
+				throw std::runtime_error("separable programs require ARB_separate_shader_objects");
 			}
-			else
+
+			id = glCreateProgram();
+			glProgramParameteri(id, GL_PROGRAM_SEPARABLE, GL_TRUE);
+
+			if (cache == nullptr)
 			{
-				std::cout << "Failed to open shader file: " << file_path << std::endl;
+				this->compile_source(stage.code, stage.type);
+				this->link();
 				return;
 			}
 
-			GLint result = GL_FALSE;
-			int info_length;
+			// separable and monolithic binaries of the same source differ, so they get their own keys
+			this->build(cache->key(hash::combine(hash_sources({ stage }), GL_PROGRAM_SEPARABLE)), *cache, [&]() {
+				this->compile_source(stage.code, stage.type);
+			});
+		}
 
-			// Compile the shader
-			char const *source_ptr = code.c_str();
-			glShaderSource(shader_id, 1, &source_ptr, NULL);
-			glCompileShader(shader_id);
+		template<typename T>
+		void upload(uniform_info *info, const T *values, size_t count)
+		{
+			using value_type = std::remove_const_t<T>;
 
-			// Check for compilation errors
-			glGetShaderiv(shader_id, GL_COMPILE_STATUS, &result);
-			glGetShaderiv(shader_id, GL_INFO_LOG_LENGTH, &info_length);
-			if (info_length > 0)
+			if (info == nullptr || count == 0)
 			{
-				std::vector<char> error_msg(info_length + 1);
-				glGetShaderInfoLog(shader_id, info_length, NULL, &error_msg[0]);
-				throw std::runtime_error(
-					std::format("shader compilation error {}", &error_msg[0]) // ugly, but deal with it.
-				);
+				return;
+			}
+
+			// never write past the end of the array, GL would reject the whole call
+			count = std::min(count, static_cast<size_t>(info->size));
+
+			if constexpr (std::is_same_v<value_type, bool>)
+			{
+				// booleans take 4 byte slots in GL and in the shadow, so the converted values are compared
+				std::vector<GLint> converted(values, values + count);
+				this->upload(info, converted.data(), count);
+				return;
+			}
+
+			if (uniforms.update(*info, values, sizeof(value_type) * count))
+			{
+				uniform_traits<value_type>::upload(id, info->location, static_cast<GLsizei>(count), values);
+			}
+		}
+
+		static stage_source read_stage(const char *file_path, shader_type type)
+		{
+			return stage_source { type, read_file(file_path).value_or("") };
+		}
+
+		void build(const std::vector<stage_source> &stages, program_cache &cache)
+		{
+			this->build(cache.key(hash_sources(stages)), cache, [&]() {
+				for (const stage_source &stage : stages)
+				{
+					this->compile_source(stage.code, stage.type);
+				}
+			});
+		}
+
+		template<typename F>
+		void build(uint64_t key, program_cache &cache, F &&compile_stages)
+		{
+			if (cache.load(id, key))
+			{
+				uniforms.reflect(id);
+				return;
+			}
+
+			glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+			compile_stages();
+
+			this->link();
+			cache.store(id, key);
+		}
+
+		void compile(const char *file_path, shader_type type)
+		{
+			// Read the shader code from the file
+			auto code = read_file(file_path);
+			if (code.has_value())
+			{
+				this->compile_source(*code, type);
+			}
+		}
+
+		void compile_source(std::string_view code, shader_type type)
+		{
+			uint64_t key = hash::combine(static_cast<uint64_t>(type), hash::fnv1a(code));
+
+			GLuint shader_id;
+
+			try
+			{
+				shader_id = stage_cache::get().acquire(key, [&]() {
+					GLuint created = glCreateShader(static_cast<int>(type));
+
+					// Compile the shader
+					char const *source_ptr = code.data();
+					GLint source_length = static_cast<GLint>(code.size());
+					glShaderSource(created, 1, &source_ptr, &source_length);
+					glCompileShader(created);
+
+					try
+					{
+						check_compile(created);
+					}
+					catch (...)
+					{
+						glDeleteShader(created);
+						throw;
+					}
+
+					return created;
+				});
+			}
+			catch (...)
+			{
+				// the constructor won't finish, so nothing else cleans up after this program
+				this->release_stages();
+				glDeleteProgram(id);
+				throw;
 			}
 
 			glAttachShader(id, shader_id);
+			stage_ids.emplace_back(key, shader_id);
 		}
 
 		void link()
 		{
-			GLint result = GL_FALSE;
-			int log_length;
-
 			// Link the program
 			glLinkProgram(id);
 
-			// Check the program
-			glGetProgramiv(id, GL_LINK_STATUS, &result);
-			glGetProgramiv(id, GL_INFO_LOG_LENGTH, &log_length);
-			if (log_length > 0)
+			// the linked program does not need its stages anymore, detaching lets them be deleted with their last program
+			for (auto [key, stage] : stage_ids)
 			{
-				std::vector<char> error_msg(log_length + 1);
-				glGetProgramInfoLog(id, log_length, NULL, &error_msg[0]);
+				glDetachShader(id, stage);
+			}
 
-				throw std::runtime_error("program linking error");
-				return;
+			try
+			{
+				check_link(id);
+			}
+			catch (...)
+			{
+				this->release_stages();
+				glDeleteProgram(id);
+				throw;
+			}
+
+			uniforms.reflect(id);
+		}
+
+		void release_stages()
+		{
+			for (auto [key, stage] : stage_ids)
+			{
+				stage_cache::get().release(key);
 			}
+
+			stage_ids.clear();
+		}
+
+		static uint64_t next_serial()
+		{
+			static std::atomic<uint64_t> counter = 0;
+			return ++counter;
+		}
+
+		glm::ivec3 group_count(int threads_x, int threads_y, int threads_z)
+		{
+			glm::ivec3 size = this->get_local_size();
+
+			return glm::ivec3((threads_x + size.x - 1) / size.x, (threads_y + size.y - 1) / size.y, (threads_z + size.z - 1) / size.z);
 		}
 	};
 }
@@ -0,0 +1,389 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <preprocessor.hpp>
+#include <program_cache.hpp>
+#include <shader.hpp>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace shader
+{
+	/**
+	 * Reloads programs when their shader files change on disk.
+	 *
+	 * @remarks The directories of every watched file are monitored with inotify on a background thread.
+	 *          When a file has been written, that thread drops it from its own copy of the program's
+	 *          preprocessor and expands the affected programs again with the defines they were built
+	 *          with. poll has to be called on the GL thread between frames: it compiles and links the
+	 *          finished sources, and only replaces a program if linking succeeded, so a typo just logs
+	 *          an error and keeps the last working version. The render thread never touches the file
+	 *          system. Programs are rebuilt the way they were created, i.e. through the same program
+	 *          cache, and as separable programs if they were watched with watch_separable.
+	 *
+	 *          A reloaded program gets a new ID, so anything referring to the old one (e.g. a
+	 *          program_pipeline staged by hand) has to be updated from the reload callback, which is
+	 *          also where a pipeline_cache can evict the old program. Only the stage files
+	 *          themselves are watched, files pulled in with #include are not. On platforms other than
+	 *          Linux programs are never reloaded.
+	 */
+	class shader_watcher
+	{
+	public:
+		/**
+		 * Called after a program has been replaced, with its ID from before the reload.
+		 */
+		using reload_callback = std::function<void(shader &program, GLuint previous_id)>;
+
+		shader_watcher()
+		{
+#ifdef __linux__
+			descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+			if (descriptor == -1)
+			{
+				throw std::runtime_error("unable to initialize inotify");
+			}
+
+			worker = std::thread([this]() {
+				this->work();
+			});
+#else
+			spdlog::warn("shader hot reload is only supported on Linux");
+#endif
+		}
+
+		shader_watcher(const shader_watcher &) = delete;
+		shader_watcher &operator=(const shader_watcher &) = delete;
+
+		~shader_watcher()
+		{
+#ifdef __linux__
+			stopping = true;
+			worker.join();
+
+			close(descriptor);
+#endif
+		}
+
+		/**
+		 * Starts reloading a program whenever one of its stage files changes.
+		 *
+		 * @param target        The program to replace. It must be unwatched before it is destroyed.
+		 * @param stages        The shader files the program was built from.
+		 * @param preprocessor  The preprocessor the stages were expanded with. The watcher keeps its own
+		 *                      copy of it (as configured at this point) for the background thread.
+		 * @param defines       The defines the stages were expanded with, e.g. the keywords of a variant.
+		 * @param cache         The program cache the program was built with, if any.
+		 */
+		void watch(shader &target,
+			std::vector<stage_file> stages,
+			const preprocessor &preprocessor,
+			std::vector<std::string> defines = {},
+			program_cache *cache = nullptr)
+		{
+			this->add(target, std::move(stages), preprocessor, std::move(defines), cache, false);
+		}
+
+		/**
+		 * Starts reloading a separable program (see shader::separable) whenever its stage file changes.
+		 */
+		void watch_separable(shader &target,
+			stage_file stage,
+			const preprocessor &preprocessor,
+			std::vector<std::string> defines = {},
+			program_cache *cache = nullptr)
+		{
+			this->add(target, { std::move(stage) }, preprocessor, std::move(defines), cache, true);
+		}
+
+		/**
+		 * Stops reloading a program, e.g. before it is destroyed.
+		 */
+		void unwatch(shader &target)
+		{
+			std::lock_guard lock(mutex);
+
+			std::erase_if(programs, [&](const watched_program &program) {
+				return program.target == &target;
+			});
+		}
+
+		/**
+		 * Sets the function called after every successful reload, e.g.
+		 *
+		 *     watcher.set_reload_callback([&](shader::shader &, GLuint previous) { pipelines.evict(previous); });
+		 */
+		void set_reload_callback(reload_callback callback)
+		{
+			on_reload = std::move(callback);
+		}
+
+		/**
+		 * Rebuilds every program whose sources have been expanded again since the last call. This never
+		 * waits on the background thread or the file system.
+		 *
+		 * @return The number of programs that were replaced.
+		 */
+		int poll()
+		{
+			std::unordered_map<uint64_t, std::vector<stage_source>> finished;
+
+			{
+				std::lock_guard lock(mutex);
+				finished.swap(ready);
+			}
+
+			int reloaded = 0;
+
+			for (auto &[serial, stages] : finished)
+			{
+				// programs is only modified on this thread, so it can be read without the lock
+				auto program = std::find_if(programs.begin(), programs.end(), [&](const watched_program &watched) {
+					return watched.serial == serial;
+				});
+
+				if (program != programs.end() && this->reload(*program, stages))
+				{
+					reloaded++;
+				}
+			}
+
+			return reloaded;
+		}
+
+	private:
+		struct watched_program {
+			uint64_t serial;
+			shader *target;
+			std::vector<stage_file> stages;
+			std::vector<std::string> defines;
+			preprocessor *pre;
+			program_cache *cache;
+			bool separable;
+		};
+
+		// only used on the GL thread
+		reload_callback on_reload;
+		uint64_t next_serial = 0;
+
+		// shared with the background thread, programs and preprocessors are only modified on the GL thread
+		std::mutex mutex;
+		std::vector<watched_program> programs;
+		std::unordered_map<const preprocessor *, std::unique_ptr<preprocessor>> preprocessors;
+		std::unordered_set<std::string> watched_files;
+		std::vector<std::filesystem::path> directories;
+		std::unordered_map<uint64_t, std::vector<stage_source>> ready;
+
+		int descriptor = -1;
+		std::atomic<bool> stopping = false;
+		std::thread worker;
+
+		void add(shader &target,
+			std::vector<stage_file> stages,
+			const preprocessor &source,
+			std::vector<std::string> defines,
+			program_cache *cache,
+			bool separable)
+		{
+			std::lock_guard lock(mutex);
+
+			for (stage_file &stage : stages)
+			{
+				stage.path = std::filesystem::absolute(stage.path).lexically_normal();
+				std::string path = stage.path.string();
+
+				if (watched_files.contains(path))
+				{
+					continue;
+				}
+
+#ifdef __linux__
+				std::filesystem::path directory = stage.path.parent_path();
+
+				if (std::find(directories.begin(), directories.end(), directory) == directories.end())
+				{
+					// editors often save by renaming a temporary file, which only shows up as IN_MOVED_TO
+					int watch = inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+					if (watch == -1)
+					{
+						// the file stays unwatched, so a later watch of it tries again
+						spdlog::warn("unable to watch shader directory {}", directory.string());
+						continue;
+					}
+
+					directories.resize(std::max<size_t>(directories.size(), watch + 1));
+					directories[watch] = directory;
+				}
+#endif
+
+				watched_files.insert(path);
+			}
+
+			std::unique_ptr<preprocessor> &copy = preprocessors[&source];
+
+			if (copy == nullptr)
+			{
+				copy = std::make_unique<preprocessor>(source);
+			}
+
+			programs.push_back({ next_serial++, &target, std::move(stages), std::move(defines), copy.get(), cache, separable });
+		}
+
+		bool reload(watched_program &program, const std::vector<stage_source> &stages)
+		{
+			GLuint previous_id = program.target->get_id();
+
+			try
+			{
+				if (program.separable)
+				{
+					*program.target = program.cache != nullptr ? shader::separable(stages.front(), *program.cache) : shader::separable(stages.front());
+				}
+				else
+				{
+					*program.target = program.cache != nullptr ? shader(stages, *program.cache) : shader(stages);
+				}
+			}
+			catch (const std::runtime_error &error)
+			{
+				spdlog::error("reloading {} failed, keeping the previous program: {}", program.stages.front().path.string(), error.what());
+				return false;
+			}
+
+			spdlog::info("reloaded {}", program.stages.front().path.string());
+
+			if (on_reload)
+			{
+				on_reload(*program.target, previous_id);
+			}
+
+			return true;
+		}
+
+#ifdef __linux__
+		void work()
+		{
+			alignas(inotify_event) char buffer[4096];
+			pollfd request { descriptor, POLLIN, 0 };
+
+			while (!stopping)
+			{
+				// wake up regularly to notice the watcher being destroyed
+				if (::poll(&request, 1, 100) <= 0)
+				{
+					continue;
+				}
+
+				ssize_t length;
+
+				while ((length = read(descriptor, buffer, sizeof(buffer))) > 0)
+				{
+					for (char *cursor = buffer; cursor < buffer + length;)
+					{
+						auto event = reinterpret_cast<inotify_event *>(cursor);
+						cursor += sizeof(inotify_event) + event->len;
+
+						if (event->len > 0)
+						{
+							this->changed_file(event->wd, event->name);
+						}
+					}
+				}
+			}
+		}
+
+		void changed_file(int watch, const char *name)
+		{
+			std::filesystem::path path;
+			std::vector<watched_program> affected;
+			std::vector<preprocessor *> copies;
+
+			{
+				std::lock_guard lock(mutex);
+
+				if (watch < 0 || static_cast<size_t>(watch) >= directories.size())
+				{
+					return;
+				}
+
+				path = directories[watch] / name;
+
+				if (!watched_files.contains(path.string()))
+				{
+					return;
+				}
+
+				for (const watched_program &program : programs)
+				{
+					bool uses = std::any_of(program.stages.begin(), program.stages.end(), [&](const stage_file &stage) {
+						return stage.path == path;
+					});
+
+					if (uses)
+					{
+						affected.push_back(program);
+					}
+				}
+
+				for (auto &[source, copy] : preprocessors)
+				{
+					copies.push_back(copy.get());
+				}
+			}
+
+			// the copies are only used on this thread, so they are expanded without holding the lock
+			for (preprocessor *copy : copies)
+			{
+				copy->invalidate(path);
+			}
+
+			std::unordered_map<uint64_t, std::vector<stage_source>> expanded;
+
+			for (const watched_program &program : affected)
+			{
+				std::vector<stage_source> stages;
+
+				try
+				{
+					for (const stage_file &stage : program.stages)
+					{
+						stages.push_back({ stage.type, program.pre->expand(stage.path, program.defines) });
+					}
+				}
+				catch (const std::runtime_error &error)
+				{
+					spdlog::error("reloading {} failed, keeping the previous program: {}", program.stages.front().path.string(), error.what());
+					continue;
+				}
+
+				expanded[program.serial] = std::move(stages);
+			}
+
+			std::lock_guard lock(mutex);
+
+			for (auto &[serial, stages] : expanded)
+			{
+				ready[serial] = std::move(stages);
+			}
+		}
+#endif
+	};
+}
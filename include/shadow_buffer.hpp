@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <buffer.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace buffer
+{
+	struct flush_stats {
+		int writes = 0;
+		int uploads = 0;
+		int bytes_written = 0;
+		int bytes_uploaded = 0;
+
+		/**
+		 * Returns how many dirty ranges were folded into a neighbouring or overlapping range.
+		 */
+		int ranges_merged() const
+		{
+			return writes - uploads;
+		}
+
+		/**
+		 * Returns how many bytes did not have to be uploaded because they were overwritten
+		 * more than once before the flush.
+		 */
+		int bytes_saved() const
+		{
+			return bytes_written - bytes_uploaded;
+		}
+	};
+
+	/**
+	 * Keeps a CPU copy of a buffer and batches writes to it.
+	 *
+	 * @remarks Writes only go to the CPU copy and record a dirty range. flush merges all adjacent and
+	 *          overlapping ranges and uploads each merged range once, so many small neighbouring
+	 *          writes in a frame end up as a handful of uploads. flush should be called once per frame,
+	 *          before the draws that read from the buffer.
+	 */
+	class shadow_buffer
+	{
+	public:
+		shadow_buffer(buffer &target)
+			: target { target }
+			, shadow(target.get_size())
+		{
+		}
+
+		/**
+		 * Writes a portion of data into the CPU copy and marks it as dirty.
+		 *
+		 * @param data        A pointer to the data that will be written.
+		 * @param data_size   The size (in bytes) of the data to be written.
+		 * @param offset      The offset (in bytes) at which to write the data in the buffer.
+		 */
+		void write(const void *data, int data_size, int offset)
+		{
+			if (offset < 0 || data_size < 0 || offset + data_size > static_cast<int>(shadow.size()))
+			{
+				throw std::out_of_range("shadow buffer write out of range");
+			}
+
+			if (data_size == 0)
+			{
+				return;
+			}
+
+			std::memcpy(shadow.data() + offset, data, data_size);
+			dirty.push_back({ offset, offset + data_size });
+
+			pending.writes++;
+			pending.bytes_written += data_size;
+		}
+
+		/**
+		 * Uploads every dirty range to the buffer, merging adjacent and overlapping ranges first.
+		 *
+		 * @return The statistics of this flush, which are also kept until the next one.
+		 */
+		flush_stats flush()
+		{
+			std::sort(dirty.begin(), dirty.end(), [](const range &a, const range &b) {
+				return a.begin < b.begin;
+			});
+
+			for (size_t i = 0; i < dirty.size();)
+			{
+				range merged = dirty[i++];
+
+				while (i < dirty.size() && dirty[i].begin <= merged.end)
+				{
+					merged.end = std::max(merged.end, dirty[i++].end);
+				}
+
+				target.write(shadow.data() + merged.begin, merged.end - merged.begin, merged.begin);
+
+				pending.uploads++;
+				pending.bytes_uploaded += merged.end - merged.begin;
+			}
+
+			dirty.clear();
+
+			last = pending;
+			pending = {};
+
+			return last;
+		}
+
+		/**
+		 * Resizes the CPU copy to match the buffer, e.g. after the buffer itself was resized.
+		 */
+		void sync_size()
+		{
+			shadow.resize(target.get_size());
+		}
+
+		flush_stats get_stats() const
+		{
+			return last;
+		}
+
+		const char *data() const
+		{
+			return shadow.data();
+		}
+
+	private:
+		struct range {
+			int begin;
+			int end;
+		};
+
+		buffer &target;
+		std::vector<char> shadow;
+		std::vector<range> dirty;
+
+		flush_stats pending;
+		flush_stats last;
+	};
+}
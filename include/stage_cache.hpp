@@ -0,0 +1,120 @@
+#pragma once
+#include <GL/glew.h>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+
+namespace shader
+{
+	/**
+	 * Shares compiled shader objects between every program built from the same source.
+	 *
+	 * @remarks Stages are keyed by a hash of their type and fully expanded source, so preprocessor
+	 *          defines are part of the key. Every program holds a reference to the stages it was linked
+	 *          from and detaches them right after linking, and a stage object is deleted as soon as the
+	 *          last program referring to it is gone, so the driver can drop its memory right away (e.g.
+	 *          the previous version of a hot-reloaded stage). The cache may only be used from the thread
+	 *          owning the GL context.
+	 */
+	class stage_cache
+	{
+	public:
+		static stage_cache &get()
+		{
+			static stage_cache cache;
+			return cache;
+		}
+
+		stage_cache(const stage_cache &) = delete;
+		stage_cache &operator=(const stage_cache &) = delete;
+
+		/**
+		 * Returns the shader object for a source, compiling it only if it is not cached yet.
+		 *
+		 * @param key      The hash of the stage's type and source.
+		 * @param compile  Creates and compiles the shader object, throwing (after deleting it) on failure.
+		 *
+		 * @return The shader object, referenced once more until release is called.
+		 */
+		template<typename F>
+		GLuint acquire(uint64_t key, F &&compile)
+		{
+			auto it = stages.find(key);
+
+			if (it == stages.end())
+			{
+				it = stages.emplace(key, entry { compile(), 0 }).first;
+				compiled++;
+			}
+			else
+			{
+				reused++;
+			}
+
+			it->second.references++;
+			return it->second.stage;
+		}
+
+		/**
+		 * Drops a reference taken by acquire, deleting the shader object once nothing refers to it.
+		 *
+		 * @param key  The key the stage was acquired with.
+		 */
+		void release(uint64_t key)
+		{
+			auto it = stages.find(key);
+
+			// this runs from destructors, so a mismatch is logged instead of thrown
+			if (it == stages.end() || it->second.references <= 0)
+			{
+				assert(false && "released a shader stage that is not cached");
+				spdlog::error("released shader stage {:016x} which is not cached", key);
+				return;
+			}
+
+			if (--it->second.references == 0)
+			{
+				glDeleteShader(it->second.stage);
+				stages.erase(it);
+			}
+		}
+
+		/**
+		 * Returns the number of cached shader objects.
+		 */
+		size_t size() const
+		{
+			return stages.size();
+		}
+
+		/**
+		 * Returns how many stages had to be compiled.
+		 */
+		int get_compiled() const
+		{
+			return compiled;
+		}
+
+		/**
+		 * Returns how many stages were taken from the cache instead of being compiled again.
+		 */
+		int get_reused() const
+		{
+			return reused;
+		}
+
+	private:
+		struct entry {
+			GLuint stage;
+			int references;
+		};
+
+		std::unordered_map<uint64_t, entry> stages;
+		int compiled = 0;
+		int reused = 0;
+
+		stage_cache() = default;
+	};
+}
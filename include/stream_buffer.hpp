@@ -0,0 +1,255 @@
+#pragma once
+#include <GL/glew.h>
+#include <buffer.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+enum class stream_flush : int
+{
+	coherent,
+	explicit_flush
+};
+
+namespace buffer
+{
+	/**
+	 * A region of a stream_buffer handed out for the current frame.
+	 *
+	 * @remarks "ptr" points into persistently mapped memory and may be written to with a plain
+	 *          memcpy. "offset" is relative to the start of the whole GL buffer, so it can be used
+	 *          directly as an attribute offset or with glBindBufferRange.
+	 */
+	struct stream_range {
+		void *ptr;
+		int offset;
+		int size;
+	};
+
+	class stream_buffer
+	{
+	public:
+		/**
+		 * Creates a persistently mapped ring buffer made of several per-frame regions.
+		 *
+		 * @param region_size   The size (in bytes) of a single frame's region.
+		 * @param buffer_type   The type of buffer being created.
+		 * @param regions       The number of frames that may be in flight at once.
+		 * @param flush         Whether the mapping is coherent or flushed explicitly at the end of a frame.
+		 *
+		 * @remarks The storage is allocated once using glBufferStorage and mapped once for the lifetime
+		 *          of the object, so writes never go through the driver. Each region is guarded by a
+		 *          fence which is waited on before the region is reused. This requires OpenGL 4.4 or
+		 *          ARB_buffer_storage.
+		 */
+		stream_buffer(int region_size, buffer_type buffer_type, int regions = 3, stream_flush flush = stream_flush::coherent)
+			: _buffer_type { buffer_type }
+			, _flush { flush }
+			, region_size { region_size }
+			, fences(regions, nullptr)
+		{
+			if (!GLEW_ARB_buffer_storage)
+			{
+				throw std::runtime_error("stream_buffer requires ARB_buffer_storage");
+			}
+
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT;
+			flags |= flush == stream_flush::coherent ? GL_MAP_COHERENT_BIT : 0;
+
+			GLbitfield map_flags = flags;
+			map_flags |= flush == stream_flush::explicit_flush ? GL_MAP_FLUSH_EXPLICIT_BIT : 0;
+
+			deletion_queue::get().created();
+
+			if (direct_state_access())
+			{
+				glCreateBuffers(1, &buffer_id);
+				glNamedBufferStorage(buffer_id, get_size(), nullptr, flags);
+				mapped = static_cast<char *>(glMapNamedBufferRange(buffer_id, 0, get_size(), map_flags));
+			}
+			else
+			{
+				glGenBuffers(1, &buffer_id);
+				glBindBuffer(static_cast<int>(_buffer_type), buffer_id);
+				glBufferStorage(static_cast<int>(_buffer_type), get_size(), nullptr, flags);
+				mapped = static_cast<char *>(glMapBufferRange(static_cast<int>(_buffer_type), 0, get_size(), map_flags));
+				glBindBuffer(static_cast<int>(_buffer_type), 0);
+			}
+
+			if (mapped == nullptr)
+			{
+				throw std::runtime_error("unable to map stream buffer");
+			}
+		}
+
+		stream_buffer(const stream_buffer &) = delete;
+		stream_buffer &operator=(const stream_buffer &) = delete;
+
+		~stream_buffer()
+		{
+			for (GLsync fence : fences)
+			{
+				if (fence != nullptr)
+				{
+					glDeleteSync(fence);
+				}
+			}
+
+			if (direct_state_access())
+			{
+				glUnmapNamedBuffer(buffer_id);
+			}
+			else
+			{
+				glBindBuffer(static_cast<int>(_buffer_type), buffer_id);
+				glUnmapBuffer(static_cast<int>(_buffer_type));
+				glBindBuffer(static_cast<int>(_buffer_type), 0);
+			}
+
+			deletion_queue::get().destroy(buffer_id);
+		}
+
+		/**
+		 * Starts writing into the region of the current frame.
+		 *
+		 * @remarks If the GPU is still reading from this region (i.e. it was used "regions" frames ago
+		 *          and that frame has not finished yet), this blocks until its fence has signalled. With
+		 *          enough regions this should practically never wait.
+		 */
+		void begin_frame()
+		{
+			GLsync &fence = fences[region];
+
+			if (fence != nullptr)
+			{
+				GLbitfield flags = 0;
+				GLenum result;
+
+				while ((result = glClientWaitSync(fence, flags, 1'000'000)) == GL_TIMEOUT_EXPIRED)
+				{
+					flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+				}
+
+				if (result == GL_WAIT_FAILED)
+				{
+					throw std::runtime_error("failed waiting on stream buffer fence");
+				}
+
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+
+			cursor = 0;
+		}
+
+		/**
+		 * Reserves a portion of the current frame's region.
+		 *
+		 * @param size       The size (in bytes) to reserve.
+		 * @param alignment  The alignment (in bytes) of the returned offset, e.g. the uniform buffer
+		 *                   offset alignment when the range is bound with glBindBufferRange.
+		 *
+		 * @return The reserved range, which stays valid until the end of the frame.
+		 */
+		stream_range allocate(int size, int alignment = 1)
+		{
+			// the absolute offset is what gets bound, and region_size need not be a multiple of alignment
+			int base = region * region_size;
+			int offset = (base + cursor + alignment - 1) / alignment * alignment;
+
+			if (offset - base + size > region_size)
+			{
+				throw std::runtime_error("stream buffer region exhausted");
+			}
+
+			cursor = offset - base + size;
+
+			return stream_range { mapped + offset, offset, size };
+		}
+
+		/**
+		 * Copies data into the current frame's region.
+		 *
+		 * @param data       A pointer to the data that will be copied.
+		 * @param size       The size (in bytes) of the data.
+		 * @param alignment  The alignment (in bytes) of the destination offset.
+		 *
+		 * @return The range the data was written to.
+		 */
+		stream_range write(const void *data, int size, int alignment = 1)
+		{
+			stream_range range = allocate(size, alignment);
+			std::memcpy(range.ptr, data, size);
+
+			return range;
+		}
+
+		/**
+		 * Finishes the current frame's region and moves on to the next one.
+		 *
+		 * @remarks This must be called after the last draw or dispatch that reads from the region has
+		 *          been issued, as the fence placed here is what protects the region from being
+		 *          overwritten while it is still in use.
+		 */
+		void end_frame()
+		{
+			if (_flush == stream_flush::explicit_flush && cursor > 0)
+			{
+				if (direct_state_access())
+				{
+					glFlushMappedNamedBufferRange(buffer_id, region * region_size, cursor);
+				}
+				else
+				{
+					glBindBuffer(static_cast<int>(_buffer_type), buffer_id);
+					glFlushMappedBufferRange(static_cast<int>(_buffer_type), region * region_size, cursor);
+					glBindBuffer(static_cast<int>(_buffer_type), 0);
+				}
+			}
+
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			region = (region + 1) % static_cast<int>(fences.size());
+		}
+
+		void bind()
+		{
+			glBindBuffer(static_cast<int>(_buffer_type), buffer_id);
+		}
+
+		/**
+		 * Binds a range of the buffer to an indexed binding point.
+		 *
+		 * @param binding  The binding point index.
+		 * @param range    A range previously returned by allocate or write.
+		 */
+		void bind_range(GLuint binding, const stream_range &range)
+		{
+			glBindBufferRange(static_cast<int>(_buffer_type), binding, buffer_id, range.offset, range.size);
+		}
+
+		GLuint get_id()
+		{
+			return buffer_id;
+		}
+
+		/**
+		 * Returns the total size (in bytes) of the buffer, i.e. all regions combined.
+		 */
+		int get_size()
+		{
+			return region_size * static_cast<int>(fences.size());
+		}
+
+	private:
+		GLuint buffer_id;
+		buffer_type _buffer_type;
+		stream_flush _flush;
+
+		char *mapped = nullptr;
+		int region_size;
+		int region = 0;
+		int cursor = 0;
+
+		std::vector<GLsync> fences;
+	};
+}
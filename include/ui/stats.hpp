@@ -0,0 +1,60 @@
+#pragma once
+#include <barrier.hpp>
+#include <deletion_queue.hpp>
+#include <framework.hpp>
+#include <gpu_profiler.hpp>
+#include <imgui.h>
+#include <stage_cache.hpp>
+#include <uniform_table.hpp>
+
+namespace ui
+{
+	/**
+	 * Draws a window with the frame-rate history, the GPU profiler's zones and the renderer's per-frame
+	 * counters.
+	 *
+	 * @remarks This has to be called from a tick, after framework::gui_frame.
+	 */
+	inline void stats_window(frame::framework &framework)
+	{
+		ImGui::Begin("stats");
+
+		frame::frame_history &history = framework.frame.frameHistory;
+		ImGui::PlotLines("frame rate", history.frames.data(), static_cast<int>(history.frames.size()));
+
+		gfx::gpu_profiler &profiler = gfx::gpu_profiler::get();
+		bool profiling = profiler.is_enabled();
+
+		if (ImGui::Checkbox("gpu profiler", &profiling))
+		{
+			profiler.set_enabled(profiling);
+		}
+
+		if (profiling)
+		{
+			const std::vector<float> &gpu_history = profiler.get_frame_history();
+			ImGui::PlotLines("gpu time (ms)", gpu_history.data(), static_cast<int>(gpu_history.size()));
+
+			for (const gfx::gpu_zone &zone : profiler.get_zones())
+			{
+				ImGui::Text("%*s%s: %.3f ms (avg %.3f ms)", zone.depth * 2, "", zone.name.c_str(), zone.milliseconds, zone.average);
+			}
+		}
+
+		ImGui::Separator();
+
+		shader::uniform_stats &uniforms = shader::uniform_stats::get();
+		ImGui::Text("uniform writes: %d issued, %d skipped", uniforms.get_issued(), uniforms.get_skipped());
+
+		gfx::barrier_tracker &barriers = gfx::barrier_tracker::get();
+		ImGui::Text("memory barriers: %d issued, %d skipped", barriers.get_issued(), barriers.get_skipped());
+
+		buffer::deletion_queue &buffers = buffer::deletion_queue::get();
+		ImGui::Text("buffers: %d live, %d pending deletion", buffers.live_count(), buffers.pending_count());
+
+		shader::stage_cache &stages = shader::stage_cache::get();
+		ImGui::Text("shader stages: %zu cached, %d compiled, %d reused", stages.size(), stages.get_compiled(), stages.get_reused());
+
+		ImGui::End();
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <buffer.hpp>
+#include <cstring>
+#include <vector>
+
+namespace buffer
+{
+	/**
+	 * A range of a uniform_allocator, to be bound with uniform_allocator::bind.
+	 */
+	struct uniform_slice {
+		int offset;
+		int size;
+	};
+
+	/**
+	 * A per-frame linear allocator over a single large uniform buffer.
+	 *
+	 * @remarks Per-object constants are pushed into a CPU staging area, each one starting at a
+	 *          multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT. flush uploads everything pushed this
+	 *          frame at once, after which every slice can be bound with glBindBufferRange. reset
+	 *          starts a new frame. If a frame pushes more than the capacity, the buffer grows on the
+	 *          next flush.
+	 */
+	class uniform_allocator
+	{
+	public:
+		uniform_allocator(int capacity = 64 * 1024)
+			: staging(capacity)
+			, uniform_buffer(nullptr, capacity, draw_type::stream_draw, buffer_type::uniform_buffer)
+		{
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			alignment = std::max(alignment, 1);
+		}
+
+		/**
+		 * Copies data into the staging area.
+		 *
+		 * @param data  A pointer to the data, laid out according to the std140 rules of the block.
+		 * @param size  The size (in bytes) of the data.
+		 *
+		 * @return The slice the data will occupy once flushed.
+		 */
+		uniform_slice push(const void *data, int size)
+		{
+			int offset = (cursor + alignment - 1) / alignment * alignment;
+
+			if (offset + size > static_cast<int>(staging.size()))
+			{
+				staging.resize(std::max(offset + size, static_cast<int>(staging.size()) * 2));
+			}
+
+			std::memcpy(staging.data() + offset, data, size);
+			cursor = offset + size;
+
+			return uniform_slice { offset, size };
+		}
+
+		template<typename T>
+		uniform_slice push(const T &value)
+		{
+			return this->push(&value, sizeof(T));
+		}
+
+		/**
+		 * Uploads everything pushed since the last reset in a single call.
+		 *
+		 * @remarks The buffer is orphaned first, so the driver can hand out fresh storage instead of
+		 *          waiting for the previous frame's draws to finish reading the old contents.
+		 */
+		void flush()
+		{
+			if (cursor == 0)
+			{
+				return;
+			}
+
+			uniform_buffer.resize(static_cast<int>(staging.size()));
+			uniform_buffer.write(staging.data(), cursor, 0);
+		}
+
+		/**
+		 * Binds a slice to a uniform block binding point.
+		 *
+		 * @param slice    A slice returned by push, from the current frame.
+		 * @param binding  The uniform block binding point index.
+		 */
+		void bind(const uniform_slice &slice, GLuint binding)
+		{
+			uniform_buffer.bind_range(binding, slice.offset, slice.size);
+		}
+
+		/**
+		 * Starts a new frame, invalidating every slice handed out so far.
+		 */
+		void reset()
+		{
+			cursor = 0;
+		}
+
+		int get_alignment() const
+		{
+			return alignment;
+		}
+
+		/**
+		 * Returns the number of bytes pushed this frame, including alignment padding.
+		 */
+		int get_used() const
+		{
+			return cursor;
+		}
+
+	private:
+		GLint alignment = 256;
+		int cursor = 0;
+
+		std::vector<char> staging;
+		buffer uniform_buffer;
+	};
+}
@@ -0,0 +1,403 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <hash.hpp>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * The hashed name of a uniform.
+	 *
+	 * @remarks Constructing a key from a string literal is consteval, so the hash is computed at compile
+	 *          time and looking a uniform up costs no string handling at all. Keys built from runtime
+	 *          strings (including plain char pointers) hash the string on every construction, so hot
+	 *          paths should keep the key around.
+	 */
+	struct uniform_key {
+		uint64_t hash;
+
+		template<size_t N>
+		consteval uniform_key(const char (&name)[N])
+			: hash { hash::fnv1a(std::string_view(name, N - 1)) }
+		{
+		}
+
+		// a template, so string literals still prefer the consteval constructor over the pointer decay
+		template<typename T>
+			requires std::same_as<T, const char *> || std::same_as<T, char *>
+		uniform_key(T name)
+			: hash { hash::fnv1a(std::string_view(name)) }
+		{
+		}
+
+		template<size_t N>
+		uniform_key(char (&name)[N])
+			: hash { hash::fnv1a(std::string_view(name)) }
+		{
+		}
+
+		uniform_key(const std::string &name)
+			: hash { hash::fnv1a(name) }
+		{
+		}
+
+		explicit constexpr uniform_key(std::string_view name)
+			: hash { hash::fnv1a(name) }
+		{
+		}
+	};
+
+	struct uniform_info {
+		uint64_t hash;
+		std::string name;
+		GLenum type;
+		GLint size;
+		GLint location;
+
+		// where the last written value lives in the table's shadow storage
+		size_t shadow_offset;
+		size_t shadow_size;
+		bool shadow_valid = false;
+	};
+
+	/**
+	 * A uniform resolved once and reused for every write.
+	 *
+	 * @remarks The handle caches the table entry together with the generation of the table it came
+	 *          from. If the program is relinked (and reflected again) the generation changes and the
+	 *          handle is resolved again from its key on the next write, so it never points at a stale entry.
+	 */
+	struct uniform_handle {
+		uniform_key key;
+		uniform_info *info = nullptr;
+		uint64_t generation = 0;
+	};
+
+	/**
+	 * Counts uniform writes that were issued to GL and writes that were skipped because the program
+	 * already held the value.
+	 */
+	class uniform_stats
+	{
+	public:
+		static uniform_stats &get()
+		{
+			static uniform_stats stats;
+			return stats;
+		}
+
+		void issued()
+		{
+			current_issued++;
+		}
+
+		void skipped()
+		{
+			current_skipped++;
+		}
+
+		/**
+		 * Publishes this frame's counts and starts counting the next frame. Called by frame::framework.
+		 */
+		void end_frame()
+		{
+			last_issued = std::exchange(current_issued, 0);
+			last_skipped = std::exchange(current_skipped, 0);
+		}
+
+		int get_issued() const
+		{
+			return last_issued;
+		}
+
+		int get_skipped() const
+		{
+			return last_skipped;
+		}
+
+	private:
+		int current_issued = 0;
+		int current_skipped = 0;
+		int last_issued = 0;
+		int last_skipped = 0;
+	};
+
+	/**
+	 * Returns the size (in bytes) of a single value of a GL uniform type, as passed to glProgramUniform*.
+	 */
+	inline size_t uniform_type_size(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT_VEC2:
+		case GL_INT_VEC2:
+		case GL_UNSIGNED_INT_VEC2:
+		case GL_BOOL_VEC2:
+		case GL_DOUBLE:
+			return 8;
+		case GL_FLOAT_VEC3:
+		case GL_INT_VEC3:
+		case GL_UNSIGNED_INT_VEC3:
+		case GL_BOOL_VEC3:
+			return 12;
+		case GL_FLOAT_VEC4:
+		case GL_INT_VEC4:
+		case GL_UNSIGNED_INT_VEC4:
+		case GL_BOOL_VEC4:
+		case GL_FLOAT_MAT2:
+		case GL_DOUBLE_VEC2:
+			return 16;
+		case GL_FLOAT_MAT2x3:
+		case GL_FLOAT_MAT3x2:
+		case GL_DOUBLE_VEC3:
+			return 24;
+		case GL_FLOAT_MAT2x4:
+		case GL_FLOAT_MAT4x2:
+		case GL_DOUBLE_VEC4:
+		case GL_DOUBLE_MAT2:
+			return 32;
+		case GL_FLOAT_MAT3:
+			return 36;
+		case GL_FLOAT_MAT3x4:
+		case GL_FLOAT_MAT4x3:
+		case GL_DOUBLE_MAT2x3:
+		case GL_DOUBLE_MAT3x2:
+			return 48;
+		case GL_FLOAT_MAT4:
+		case GL_DOUBLE_MAT2x4:
+		case GL_DOUBLE_MAT4x2:
+			return 64;
+		case GL_DOUBLE_MAT3:
+			return 72;
+		case GL_DOUBLE_MAT3x4:
+		case GL_DOUBLE_MAT4x3:
+			return 96;
+		case GL_DOUBLE_MAT4:
+			return 128;
+		default:
+			// scalars, samplers and images
+			return 4;
+		}
+	}
+
+	/**
+	 * Every active uniform of a program, enumerated once after linking.
+	 *
+	 * @remarks Uniforms are stored in a flat array and found through an open addressing table indexed
+	 *          by the name hash, so a lookup is a couple of array accesses and never queries GL. Array
+	 *          uniforms are registered under their plain name, "name[0]" and every "name[i]". The table
+	 *          also keeps a copy of the last value written to every uniform, so writes of an unchanged
+	 *          value can be skipped.
+	 */
+	class uniform_table
+	{
+	public:
+		/**
+		 * Enumerates the active uniforms of a linked program, replacing the current contents.
+		 *
+		 * @param program  The ID of the linked program.
+		 */
+		void reflect(GLuint program)
+		{
+			static uint64_t generations = 0;
+			generation = ++generations;
+
+			entries.clear();
+			shadow.clear();
+
+			GLint count = 0;
+			GLint max_length = 0;
+
+			glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+			glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+			std::vector<char> buffer(max_length + 1);
+
+			for (GLint i = 0; i < count; i++)
+			{
+				GLsizei length = 0;
+				GLint size = 0;
+				GLenum type = 0;
+
+				glGetActiveUniform(program, i, max_length, &length, &size, &type, buffer.data());
+
+				std::string name(buffer.data(), length);
+				GLint location = glGetUniformLocation(program, name.c_str());
+
+				// members of uniform blocks have no location
+				if (location == -1)
+				{
+					continue;
+				}
+
+				// every name of an array shares one shadow range, offset by the element index
+				size_t element_size = uniform_type_size(type);
+				size_t offset = shadow.size();
+
+				shadow.resize(offset + element_size * size);
+
+				if (!name.ends_with("[0]"))
+				{
+					add(name, type, size, location, offset, element_size);
+					continue;
+				}
+
+				std::string base = name.substr(0, name.size() - 3);
+
+				add(base, type, size, location, offset, element_size);
+				add(name, type, size, location, offset, element_size);
+
+				for (GLint element = 1; element < size; element++)
+				{
+					std::string element_name = base + "[" + std::to_string(element) + "]";
+					GLint element_location = glGetUniformLocation(program, element_name.c_str());
+
+					add(element_name, type, size - element, element_location, offset + element * element_size, element_size);
+				}
+			}
+
+			rebuild();
+		}
+
+		/**
+		 * Records a write to a uniform and returns whether it actually has to be issued to GL.
+		 *
+		 * @param info  The uniform being written, as returned by find.
+		 * @param data  The value being written.
+		 * @param size  The size (in bytes) of the value.
+		 *
+		 * @return False if the program already holds exactly this value, true otherwise.
+		 */
+		bool update(uniform_info &info, const void *data, size_t size)
+		{
+			if (size > info.shadow_size)
+			{
+				uniform_stats::get().issued();
+				info.shadow_valid = false;
+
+				return true;
+			}
+
+			char *stored = shadow.data() + info.shadow_offset;
+
+			if (info.shadow_valid && std::memcmp(stored, data, size) == 0)
+			{
+				uniform_stats::get().skipped();
+				return false;
+			}
+
+			std::memcpy(stored, data, size);
+			info.shadow_valid = true;
+
+			uniform_stats::get().issued();
+			return true;
+		}
+
+		/**
+		 * Looks a uniform up by its hashed name.
+		 *
+		 * @return The uniform, or nullptr if the program has no active uniform with that name.
+		 */
+		uniform_info *find(uniform_key key)
+		{
+			return const_cast<uniform_info *>(std::as_const(*this).find(key));
+		}
+
+		const uniform_info *find(uniform_key key) const
+		{
+			if (slots.empty())
+			{
+				return nullptr;
+			}
+
+			for (size_t slot = key.hash & mask;; slot = (slot + 1) & mask)
+			{
+				int32_t index = slots[slot];
+
+				if (index == empty)
+				{
+					return nullptr;
+				}
+
+				if (entries[index].hash == key.hash)
+				{
+					return &entries[index];
+				}
+			}
+		}
+
+		/**
+		 * Returns the entry a handle refers to, resolving it again if the table was rebuilt since.
+		 *
+		 * @return The uniform, or nullptr if the program has no active uniform with that name.
+		 */
+		uniform_info *resolve(uniform_handle &handle)
+		{
+			if (handle.generation != generation)
+			{
+				handle.info = find(handle.key);
+				handle.generation = generation;
+			}
+
+			return handle.info;
+		}
+
+		/**
+		 * Returns the location of a uniform, or -1 if the program has no active uniform with that name.
+		 */
+		GLint location(uniform_key key) const
+		{
+			const uniform_info *info = find(key);
+			return info != nullptr ? info->location : -1;
+		}
+
+		const std::vector<uniform_info> &get_uniforms() const
+		{
+			return entries;
+		}
+
+	private:
+		static constexpr int32_t empty = -1;
+
+		std::vector<uniform_info> entries;
+		std::vector<int32_t> slots;
+		size_t mask = 0;
+
+		std::vector<char> shadow;
+		uint64_t generation = 0;
+
+		void add(const std::string &name, GLenum type, GLint size, GLint location, size_t offset, size_t element_size)
+		{
+			entries.push_back({ hash::fnv1a(name), name, type, size, location, offset, element_size * size });
+		}
+
+		void rebuild()
+		{
+			// keep the table at most half full, so probe sequences stay short
+			size_t capacity = std::bit_ceil(std::max<size_t>(entries.size() * 2, 8));
+
+			slots.assign(capacity, empty);
+			mask = capacity - 1;
+
+			for (size_t index = 0; index < entries.size(); index++)
+			{
+				size_t slot = entries[index].hash & mask;
+
+				while (slots[slot] != empty)
+				{
+					slot = (slot + 1) & mask;
+				}
+
+				slots[slot] = static_cast<int32_t>(index);
+			}
+		}
+	};
+}
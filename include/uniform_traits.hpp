@@ -0,0 +1,156 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * Maps a C++ type to the glProgramUniform* call that uploads it.
+	 *
+	 * @remarks There is deliberately no generic definition, so setting a uniform from an unsupported
+	 *          type is a compile error instead of a silent no-op. Every upload takes a count, so arrays
+	 *          of any supported type are uploaded in a single call.
+	 */
+	template<typename T>
+	struct uniform_traits;
+
+	template<>
+	struct uniform_traits<int> {
+		static void upload(GLuint program, GLint location, GLsizei count, const int *values)
+		{
+			glProgramUniform1iv(program, location, count, values);
+		}
+	};
+
+	template<>
+	struct uniform_traits<unsigned int> {
+		static void upload(GLuint program, GLint location, GLsizei count, const unsigned int *values)
+		{
+			glProgramUniform1uiv(program, location, count, values);
+		}
+	};
+
+	template<>
+	struct uniform_traits<bool> {
+		static void upload(GLuint program, GLint location, GLsizei count, const bool *values)
+		{
+			// GLSL booleans are set through the integer entry points
+			std::vector<GLint> converted(values, values + count);
+			glProgramUniform1iv(program, location, count, converted.data());
+		}
+	};
+
+	template<>
+	struct uniform_traits<float> {
+		static void upload(GLuint program, GLint location, GLsizei count, const float *values)
+		{
+			glProgramUniform1fv(program, location, count, values);
+		}
+	};
+
+	template<>
+	struct uniform_traits<double> {
+		static void upload(GLuint program, GLint location, GLsizei count, const double *values)
+		{
+			glProgramUniform1dv(program, location, count, values);
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::vec2> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::vec2 *values)
+		{
+			glProgramUniform2fv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::vec3> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::vec3 *values)
+		{
+			glProgramUniform3fv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::vec4> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::vec4 *values)
+		{
+			glProgramUniform4fv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::ivec2> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::ivec2 *values)
+		{
+			glProgramUniform2iv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::ivec3> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::ivec3 *values)
+		{
+			glProgramUniform3iv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::ivec4> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::ivec4 *values)
+		{
+			glProgramUniform4iv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::uvec2> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::uvec2 *values)
+		{
+			glProgramUniform2uiv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::uvec3> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::uvec3 *values)
+		{
+			glProgramUniform3uiv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::uvec4> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::uvec4 *values)
+		{
+			glProgramUniform4uiv(program, location, count, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::mat2> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::mat2 *values)
+		{
+			glProgramUniformMatrix2fv(program, location, count, GL_FALSE, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::mat3> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::mat3 *values)
+		{
+			glProgramUniformMatrix3fv(program, location, count, GL_FALSE, glm::value_ptr(values[0]));
+		}
+	};
+
+	template<>
+	struct uniform_traits<glm::mat4> {
+		static void upload(GLuint program, GLint location, GLsizei count, const glm::mat4 *values)
+		{
+			glProgramUniformMatrix4fv(program, location, count, GL_FALSE, glm::value_ptr(values[0]));
+		}
+	};
+}
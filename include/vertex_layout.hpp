@@ -0,0 +1,312 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <bit>
+#include <buffer.hpp>
+#include <cmath>
+#include <cstdint>
+#include <hash.hpp>
+#include <render.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace gfx
+{
+	enum class attribute_type : int
+	{
+		float32 = GL_FLOAT,
+		float16 = GL_HALF_FLOAT,
+		int8 = GL_BYTE,
+		uint8 = GL_UNSIGNED_BYTE,
+		int16 = GL_SHORT,
+		uint16 = GL_UNSIGNED_SHORT,
+		int_2_10_10_10_rev = GL_INT_2_10_10_10_REV,
+	};
+
+	struct vertex_element {
+		GLuint location;
+		int components;
+		attribute_type type;
+		bool normalized;
+		int offset;
+	};
+
+	/**
+	 * Describes the attributes of an interleaved vertex buffer.
+	 *
+	 * @remarks Attributes are laid out in the order they are added, each starting at a 4 byte aligned
+	 *          offset, and the stride is the total size of a vertex. Smaller types (half floats,
+	 *          normalized 8/16 bit integers, packed 2_10_10_10 normals) can be used to reduce the size
+	 *          of a vertex, see the pack_* helpers below.
+	 */
+	class vertex_layout
+	{
+	public:
+		/**
+		 * Adds an attribute after the previously added attributes.
+		 *
+		 * @param location    The location of the attribute in the vertex shader.
+		 * @param components  The number of components, e.g. 3 for a position. Packed 2_10_10_10 attributes
+		 *                    always take 4 components.
+		 * @param type        The type of every component in the buffer.
+		 * @param normalized  Whether integer components are mapped to [0, 1] or [-1, 1] when fetched.
+		 */
+		vertex_layout &add(GLuint location, int components, attribute_type type = attribute_type::float32, bool normalized = false)
+		{
+			if (type == attribute_type::int_2_10_10_10_rev)
+			{
+				components = 4;
+			}
+
+			int offset = (stride + 3) & ~3;
+			elements.push_back({ location, components, type, normalized, offset });
+
+			stride = offset + element_size(components, type);
+			stride = (stride + 3) & ~3;
+
+			layout_hash = hash::combine(layout_hash, location);
+			layout_hash = hash::combine(layout_hash, components);
+			layout_hash = hash::combine(layout_hash, static_cast<uint64_t>(type));
+			layout_hash = hash::combine(layout_hash, normalized);
+
+			return *this;
+		}
+
+		/**
+		 * Configures the attributes on the currently bound vertex array, reading from the buffer
+		 * bound to GL_ARRAY_BUFFER.
+		 */
+		void apply() const
+		{
+			for (const vertex_element &element : elements)
+			{
+				gfx::enable_vertex(element.location);
+				gfx::vertex_attribute(element.location,
+					element.components,
+					static_cast<int>(element.type),
+					element.normalized,
+					stride,
+					reinterpret_cast<void *>(static_cast<intptr_t>(element.offset)));
+			}
+		}
+
+		int get_stride() const
+		{
+			return stride;
+		}
+
+		uint64_t get_hash() const
+		{
+			return layout_hash;
+		}
+
+		const std::vector<vertex_element> &get_elements() const
+		{
+			return elements;
+		}
+
+		static int element_size(int components, attribute_type type)
+		{
+			switch (type)
+			{
+			case attribute_type::float32:
+				return components * 4;
+			case attribute_type::float16:
+			case attribute_type::int16:
+			case attribute_type::uint16:
+				return components * 2;
+			case attribute_type::int8:
+			case attribute_type::uint8:
+				return components;
+			case attribute_type::int_2_10_10_10_rev:
+				return 4;
+			}
+
+			return 0;
+		}
+
+	private:
+		std::vector<vertex_element> elements;
+		int stride = 0;
+		uint64_t layout_hash = hash::fnv_offset;
+	};
+
+	/**
+	 * Caches one vertex array object per vertex layout.
+	 *
+	 * @remarks With ARB_vertex_attrib_binding (OpenGL 4.3) the attribute formats live in the vertex
+	 *          array and the buffers are attached separately, so every buffer that uses the same layout
+	 *          shares a single vertex array. Without it, the buffers are part of the vertex array state,
+	 *          so the attribute pointers of the layout's vertex array are specified again on every bind.
+	 */
+	class vertex_array_cache
+	{
+	public:
+		vertex_array_cache() = default;
+		vertex_array_cache(const vertex_array_cache &) = delete;
+		vertex_array_cache &operator=(const vertex_array_cache &) = delete;
+
+		~vertex_array_cache()
+		{
+			for (auto &[key, vao] : arrays)
+			{
+				glDeleteVertexArrays(1, &vao);
+			}
+		}
+
+		/**
+		 * Binds the vertex array for a layout, with the given buffers attached to it.
+		 *
+		 * @param layout    The layout of the vertex buffer.
+		 * @param vertices  The interleaved vertex buffer.
+		 * @param indices   An optional element buffer.
+		 *
+		 * @return The ID of the bound vertex array.
+		 */
+		GLuint bind(const vertex_layout &layout, buffer::buffer &vertices, buffer::buffer *indices = nullptr)
+		{
+			GLuint vertex_id = vertices.get_id();
+			GLuint index_id = indices != nullptr ? indices->get_id() : 0;
+
+			if (!GLEW_ARB_vertex_attrib_binding)
+			{
+				auto [it, created] = arrays.try_emplace(layout.get_hash(), 0);
+
+				if (created)
+				{
+					glGenVertexArrays(1, &it->second);
+				}
+
+				// buffer names are reused once grow or the deletion queue frees them, so the attribute
+				// pointers are specified again on every bind instead of trusting what the array holds
+				glBindVertexArray(it->second);
+				glBindBuffer(GL_ARRAY_BUFFER, vertex_id);
+				layout.apply();
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_id);
+
+				return it->second;
+			}
+
+			auto [it, created] = arrays.try_emplace(layout.get_hash(), 0);
+
+			if (created)
+			{
+				glGenVertexArrays(1, &it->second);
+				glBindVertexArray(it->second);
+
+				for (const vertex_element &element : layout.get_elements())
+				{
+					glEnableVertexAttribArray(element.location);
+					glVertexAttribFormat(element.location, element.components, static_cast<int>(element.type), element.normalized, element.offset);
+					glVertexAttribBinding(element.location, 0);
+				}
+			}
+			else
+			{
+				glBindVertexArray(it->second);
+			}
+
+			glBindVertexBuffer(0, vertex_id, 0, layout.get_stride());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_id);
+
+			return it->second;
+		}
+
+		/**
+		 * Returns the number of vertex arrays in the cache.
+		 */
+		size_t size() const
+		{
+			return arrays.size();
+		}
+
+	private:
+		std::unordered_map<uint64_t, GLuint> arrays;
+	};
+
+	/**
+	 * Converts a float to an IEEE 754 half float, rounding to nearest even.
+	 */
+	inline uint16_t pack_half(float value)
+	{
+		uint32_t bits = std::bit_cast<uint32_t>(value);
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t mantissa = bits & 0x7fffff;
+		int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+
+		if (((bits >> 23) & 0xff) == 0xff)
+		{
+			return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+		}
+
+		if (exponent >= 31)
+		{
+			return sign | 0x7c00;
+		}
+
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+			{
+				return sign;
+			}
+
+			mantissa |= 0x800000;
+
+			uint32_t shift = 14 - exponent;
+			uint32_t half = mantissa >> shift;
+			uint32_t remainder = mantissa & ((1u << shift) - 1);
+			uint32_t midpoint = 1u << (shift - 1);
+
+			if (remainder > midpoint || (remainder == midpoint && (half & 1)))
+			{
+				half++;
+			}
+
+			return sign | half;
+		}
+
+		uint32_t half = (exponent << 10) | (mantissa >> 13);
+		uint32_t remainder = mantissa & 0x1fff;
+
+		// a carry out of the mantissa correctly rounds up into the exponent (or infinity)
+		if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		{
+			half++;
+		}
+
+		return sign | half;
+	}
+
+	/**
+	 * Packs a float in [-1, 1] into a normalized signed 16 bit integer.
+	 */
+	inline int16_t pack_snorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	/**
+	 * Packs a float in [0, 1] into a normalized unsigned 8 bit integer, e.g. for colors.
+	 */
+	inline uint8_t pack_unorm8(float value)
+	{
+		return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+	}
+
+	/**
+	 * Packs a normal (or any vector in [-1, 1]) into a GL_INT_2_10_10_10_REV value, to be used with a
+	 * normalized attribute_type::int_2_10_10_10_rev attribute.
+	 */
+	inline uint32_t pack_normal(float x, float y, float z, float w = 0.0f)
+	{
+		auto component = [](float value, float scale, uint32_t mask) {
+			return static_cast<uint32_t>(static_cast<int32_t>(std::round(std::clamp(value, -1.0f, 1.0f) * scale))) & mask;
+		};
+
+		return component(x, 511.0f, 0x3ff)
+			| component(y, 511.0f, 0x3ff) << 10
+			| component(z, 511.0f, 0x3ff) << 20
+			| component(w, 1.0f, 0x3) << 30;
+	}
+}
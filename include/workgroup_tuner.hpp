@@ -0,0 +1,238 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <glm/glm.hpp>
+#include <hash.hpp>
+#include <program_cache.hpp>
+#include <limits>
+#include <optional>
+#include <preprocessor.hpp>
+#include <shader.hpp>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace shader
+{
+	/**
+	 * Picks the fastest local size of a compute shader on the current device.
+	 *
+	 * @remarks The shader declares its local size through defines injected by the tuner:
+	 *
+	 *              layout(local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y, local_size_z = LOCAL_SIZE_Z) in;
+	 *
+	 *          In tuning mode, a kernel without a stored result is compiled once per candidate size and
+	 *          each variant is timed with GL_TIME_ELAPSED queries over a representative workload. The
+	 *          winner is stored per device (vendor, renderer and driver version), kernel source and
+	 *          candidate list, so later launches compile the tuned size straight away. Outside tuning
+	 *          mode, kernels without a result use the first candidate. Dispatching with
+	 *          shader::dispatch_threads makes callers independent of whichever size was chosen.
+	 */
+	class workgroup_tuner
+	{
+	public:
+		/**
+		 * @param preprocessor  The preprocessor used to expand the kernels. It must outlive the tuner.
+		 * @param results_file  The file the tuned sizes are stored in, created on the first tuning.
+		 */
+		workgroup_tuner(preprocessor &preprocessor, std::filesystem::path results_file)
+			: pre { preprocessor }
+			, results_file { std::move(results_file) }
+		{
+			device_hash = ::shader::device_hash();
+
+			glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_invocations);
+
+			for (GLuint axis = 0; axis < 3; axis++)
+			{
+				glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, axis, &max_size[axis]);
+			}
+
+			this->load();
+		}
+
+		/**
+		 * Enables or disables timing kernels that have no stored result yet.
+		 */
+		void set_tuning(bool enabled)
+		{
+			tuning = enabled;
+		}
+
+		/**
+		 * Sets how many times every candidate is dispatched while it is being timed.
+		 */
+		void set_iterations(int count)
+		{
+			iterations = count;
+		}
+
+		/**
+		 * Compiles a kernel with its tuned local size, tuning it first if needed.
+		 *
+		 * @param file        The path of the compute shader.
+		 * @param candidates  The local sizes to try, the first one is the default when not tuning.
+		 * @param workload    Issues a representative dispatch of the given program, e.g. with
+		 *                    dispatch_threads. Its buffers have to be bound already.
+		 * @param defines     Any other defines of the kernel.
+		 */
+		shader get(const std::filesystem::path &file,
+			const std::vector<glm::ivec3> &candidates,
+			const std::function<void(shader &)> &workload,
+			std::vector<std::string> defines = {})
+		{
+			if (candidates.empty())
+			{
+				throw std::runtime_error("workgroup tuning requires at least one candidate");
+			}
+
+			uint64_t key = hash::combine(device_hash, hash::fnv1a(pre.expand(file, defines)));
+
+			// a winner is only valid among the candidates it was picked from
+			for (glm::ivec3 candidate : candidates)
+			{
+				key = hash::combine(hash::combine(hash::combine(key, candidate.x), candidate.y), candidate.z);
+			}
+
+			auto result = results.find(key);
+			if (result != results.end())
+			{
+				return compile(file, defines, result->second);
+			}
+
+			if (!tuning)
+			{
+				return compile(file, defines, candidates.front());
+			}
+
+			auto [size, program] = tune(file, candidates, workload, defines);
+
+			results[key] = size;
+			this->save();
+
+			return std::move(program);
+		}
+
+	private:
+		preprocessor &pre;
+		std::filesystem::path results_file;
+		std::unordered_map<uint64_t, glm::ivec3> results;
+
+		uint64_t device_hash = hash::fnv_offset;
+		GLint max_invocations = 0;
+		GLint max_size[3] = {};
+
+		bool tuning = false;
+		int iterations = 8;
+
+		shader compile(const std::filesystem::path &file, std::vector<std::string> defines, glm::ivec3 size)
+		{
+			defines.push_back(std::format("LOCAL_SIZE_X {}", size.x));
+			defines.push_back(std::format("LOCAL_SIZE_Y {}", size.y));
+			defines.push_back(std::format("LOCAL_SIZE_Z {}", size.z));
+
+			return shader({ stage_source { shader_type::Compute, pre.expand(file, defines) } });
+		}
+
+		bool fits(glm::ivec3 size) const
+		{
+			return size.x > 0 && size.y > 0 && size.z > 0
+				&& size.x <= max_size[0] && size.y <= max_size[1] && size.z <= max_size[2]
+				&& size.x * size.y * size.z <= max_invocations;
+		}
+
+		std::pair<glm::ivec3, shader> tune(const std::filesystem::path &file,
+			const std::vector<glm::ivec3> &candidates,
+			const std::function<void(shader &)> &workload,
+			const std::vector<std::string> &defines)
+		{
+			std::optional<shader> best;
+			glm::ivec3 best_size = candidates.front();
+			GLuint64 best_time = std::numeric_limits<GLuint64>::max();
+
+			GLuint query;
+			glGenQueries(1, &query);
+
+			for (glm::ivec3 size : candidates)
+			{
+				if (!fits(size))
+				{
+					continue;
+				}
+
+				std::optional<shader> program;
+
+				try
+				{
+					program.emplace(compile(file, defines, size));
+				}
+				catch (const std::runtime_error &error)
+				{
+					spdlog::warn("{}: local size {}x{}x{} failed to compile: {}", file.string(), size.x, size.y, size.z, error.what());
+					continue;
+				}
+
+				// the first dispatch may include driver work (e.g. a deferred compile), so it is not timed
+				workload(*program);
+
+				glBeginQuery(GL_TIME_ELAPSED, query);
+
+				for (int i = 0; i < iterations; i++)
+				{
+					workload(*program);
+				}
+
+				glEndQuery(GL_TIME_ELAPSED);
+
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+				spdlog::info("{}: local size {}x{}x{} took {} ns", file.string(), size.x, size.y, size.z, elapsed / iterations);
+
+				if (elapsed < best_time)
+				{
+					best_time = elapsed;
+					best_size = size;
+					best = std::move(program);
+				}
+			}
+
+			glDeleteQueries(1, &query);
+
+			if (!best.has_value())
+			{
+				throw std::runtime_error(std::format("no local size of {} could be compiled", file.string()));
+			}
+
+			spdlog::info("{}: using local size {}x{}x{}", file.string(), best_size.x, best_size.y, best_size.z);
+			return { best_size, std::move(*best) };
+		}
+
+		void load()
+		{
+			std::ifstream stream(results_file);
+			uint64_t key;
+			glm::ivec3 size;
+
+			while (stream >> std::hex >> key >> std::dec >> size.x >> size.y >> size.z)
+			{
+				results[key] = size;
+			}
+		}
+
+		void save() const
+		{
+			std::ofstream stream(results_file, std::ios::trunc);
+
+			for (const auto &[key, size] : results)
+			{
+				stream << std::format("{:016x} {} {} {}\n", key, size.x, size.y, size.z);
+			}
+		}
+	};
+}
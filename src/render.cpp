@@ -47,6 +47,18 @@ namespace gfx
 		);
 	}
 
+	void vertex_attribute(int attributeIndex, int size, int type, bool normalized, int stride, void *offset)
+	{
+		glVertexAttribPointer(
+			attributeIndex, // attribute index
+			size, // size
+			type, // type
+			normalized ? GL_TRUE : GL_FALSE, // normalized
+			stride, // stride
+			offset // array buffer offset
+		);
+	}
+
 	void draw_arrays(int attributeIndex, int count)
 	{
 		glDrawArrays(GL_TRIANGLES, 0, count);
@@ -56,6 +68,31 @@ namespace gfx
 	{
 		glDrawElements(GL_TRIANGLES, indices, GL_UNSIGNED_INT, (void *) 0);
 	}
+
+	void draw_elements_base_vertex(int indices, int first_index, int base_vertex)
+	{
+		glDrawElementsBaseVertex(
+			GL_TRIANGLES,
+			indices,
+			GL_UNSIGNED_INT,
+			(void *) (first_index * sizeof(GLuint)),
+			base_vertex);
+	}
+
+	void multi_draw_elements_indirect(int draw_count)
+	{
+		if (GLEW_ARB_multi_draw_indirect)
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *) 0, draw_count, 0);
+			return;
+		}
+
+		// DrawElementsIndirectCommand is five 32 bit integers
+		for (int i = 0; i < draw_count; i++)
+		{
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *) (i * 5 * sizeof(GLuint)));
+		}
+	}
 }
 
 namespace imgui